@@ -0,0 +1,26 @@
+#!/bin/sh
+
+# Builds the tracer and runs its benchmark suite, writing the results to bench.json
+# Given the results of an earlier run, such as ./bench.sh baseline.json, fails on any regression
+
+echo BUILDING...
+
+g++ -std=c++11 -Wall -O3 -march=native -pthread -o launch \
+src/main.cpp \
+-lglfw -lGLEW -lGL || exit 1
+
+# Adaptive renders whose budget is met from the first pass, with each integrator
+for wavefront in 0 1; do
+    ./launch --headless -w 64 --height 36 -s 4 --max-spp 4 --threshold 0.1 --wavefront $wavefront -o bench_check.ppm 2> /dev/null \
+    || { echo "Adaptive render with --wavefront $wavefront failed"; exit 1; }
+done
+rm -f bench_check.ppm
+
+if [ -n "$1" ]; then
+    ./launch --bench --baseline "$1" > bench.json
+else
+    ./launch --bench > bench.json
+fi
+status=$?
+cat bench.json
+exit $status
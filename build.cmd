@@ -2,7 +2,7 @@
 
 echo BUILDING...
 
-g++ -std=c++11 -Wall -O3 -march=native -o launch.exe ^
+g++ -std=c++11 -Wall -O3 -march=native -pthread -o launch.exe ^
 src/main.cpp ^
 -I "C:\Programs\C++\Libraries\glfw.3.3.2.bin.WIN64\include" ^
 -I "C:\Programs\C++\Libraries\glm.0.9.9.8" ^
@@ -0,0 +1,13 @@
+#!/bin/sh
+
+echo BUILDING...
+
+g++ -std=c++11 -Wall -O3 -march=native -pthread -o launch \
+src/main.cpp \
+-lglfw -lGLEW -lGL
+
+if [ $? -eq 0 ]; then
+   echo "BUILT ./launch (run ./launch --headless for display-less renders)"
+else
+   exit 1
+fi
@@ -0,0 +1,26 @@
+#!/bin/sh
+
+# Builds the tracer and renders one image with a coordinator and local worker processes
+# Takes the number of workers, then any render options, such as ./cluster.sh 4 -s 256 -o out.ppm
+# Workers on other machines of the same architecture may join with ./launch --join HOST:7878
+
+echo BUILDING...
+
+g++ -std=c++11 -Wall -O3 -march=native -pthread -o launch \
+src/main.cpp \
+-lglfw -lGLEW -lGL || exit 1
+
+workers=${1:-2}
+[ $# -gt 0 ] && shift
+
+./launch --serve :7878 "$@" &
+serve=$!
+i=0
+while [ $i -lt "$workers" ]; do
+    ./launch --join localhost:7878 --threads 1 &
+    i=$((i + 1))
+done
+wait $serve
+status=$?
+wait
+exit $status
@@ -0,0 +1,21 @@
+#!/bin/sh
+
+# Builds the tracer in double and in float, then times both and compares their images
+# Extra arguments go to both renders, such as -w 640 --height 360 -s 64
+
+echo BUILDING...
+
+for precision in 0 1; do
+    g++ -std=c++11 -Wall -O3 -march=native -pthread -DFLOAT_PRECISION=$precision -o launch_$precision \
+    src/main.cpp \
+    -lglfw -lGLEW -lGL || exit 1
+done
+
+for precision in 0 1; do
+    [ $precision -eq 0 ] && echo "DOUBLE" || echo "FLOAT"
+    ./launch_$precision --bench-primary || exit 1
+    ./launch_$precision --headless -o precision_$precision.pfm "$@" || exit 1
+done
+
+echo "FLOAT AGAINST DOUBLE"
+./launch_0 --diff precision_0.pfm precision_1.pfm
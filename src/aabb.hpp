@@ -0,0 +1,79 @@
+#ifndef AABB_H_
+#define AABB_H_
+
+#include <glm/glm.hpp>
+#include <utility>
+#include "ray.hpp"
+#include "real.hpp"
+
+// Widens the far side of slab tests by their rounding, so a ray grazing a box face
+// is never turned away from a primitive lying in that face
+static const Real SLAB_ROUNDING = 1 + 4 * EPSILON;
+
+// Axis aligned bounding box
+struct AABB
+{
+    Vec3 lo;
+    Vec3 hi;
+
+    // An empty box, ready to grow
+    AABB() : lo(INF), hi(-INF) { }
+    AABB(const Vec3& lo, const Vec3& hi) : lo(lo), hi(hi) { }
+
+    void grow(const Vec3& point)
+    {
+        lo = glm::min(lo, point);
+        hi = glm::max(hi, point);
+    }
+
+    void grow(const AABB& box)
+    {
+        lo = glm::min(lo, box.lo);
+        hi = glm::max(hi, box.hi);
+    }
+
+    // Whether the box is finite and holds at least a point, unlike an empty one
+    bool valid() const
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            if (!(lo[k] <= hi[k] && lo[k] > -INF && hi[k] < INF)) return false;
+        }
+        return true;
+    }
+
+    Vec3 centre() const
+    {
+        return (lo + hi) * Real(0.5);
+    }
+
+    // Half the surface area, which is all the SAH needs
+    Real area() const
+    {
+        Vec3 d = hi - lo;
+        if (d.x < 0) return 0;
+        return d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+
+    // Slab test, given the reciprocal of the ray direction
+    // A ray parallel to a slab and starting in its plane gives 0 * inf, which is NaN, so the
+    // planes are picked by the ray's sign and compared such that a NaN slab is ignored
+    bool hit(const Ray& ray, const Vec3& inv, Real tMin, Real tMax, Real& tNear) const
+    {
+        Vec3 t0 = (lo - ray.org) * inv;
+        Vec3 t1 = (hi - ray.org) * inv;
+        for (int k = 0; k < 3; ++k)
+        {
+            if (inv[k] < 0) std::swap(t0[k], t1[k]);
+        }
+        tNear = t0.x > tMin ? t0.x : tMin;
+        tNear = t0.y > tNear ? t0.y : tNear;
+        tNear = t0.z > tNear ? t0.z : tNear;
+        Real tFar = t1.x < tMax ? t1.x : tMax;
+        tFar = t1.y < tFar ? t1.y : tFar;
+        tFar = t1.z < tFar ? t1.z : tFar;
+        return tNear <= tFar * SLAB_ROUNDING;
+    }
+};
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "config.hpp"
+#include "kernels.hpp"
+#include "options.hpp"
+
+// Every benchmark renders the same image, whatever the options say
+static const int BENCH_WIDTH = 320;
+static const int BENCH_HEIGHT = 180;
+static const int BENCH_SPP = 16;
+static const int BENCH_DEPTH = RAY_DEPTH;
+static const uint32_t BENCH_SEED = 1;
+
+// Share of a baseline's throughput a benchmark may lose before it counts as a regression
+static const double BENCH_TOLERANCE = 0.1;
+
+// Timings of one benchmark scene, in milliseconds
+struct BenchResult
+{
+    std::string name;
+    size_t objects = 0;
+    double build = 0.0;
+    double render = 0.0;
+    double display = 0.0;
+    uint64_t rays = 0;
+    double raysPerPath = 0.0;
+
+    double mrays() const { return render > 0.0 ? rays / render / 1000.0 : 0.0; }
+};
+
+// Quotes text for JSON
+inline std::string jsonString(const std::string& text)
+{
+    std::string quoted = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\') quoted += '\\';
+        if (c >= ' ') quoted += c;
+    }
+    return quoted + "\"";
+}
+
+// The processor's name, as the system reports it
+inline std::string cpuName()
+{
+#ifdef _WIN32
+    const char* name = std::getenv("PROCESSOR_IDENTIFIER");
+    if (name) return name;
+#else
+    std::ifstream info("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(info, line))
+    {
+        if (line.compare(0, 10, "model name") != 0) continue;
+        const size_t colon = line.find(':');
+        if (colon != std::string::npos) return line.substr(line.find_first_not_of(' ', colon + 1));
+    }
+#endif
+    return "unknown";
+}
+
+inline std::string osName()
+{
+#if defined(_WIN32)
+    return "windows";
+#elif defined(__APPLE__)
+    return "macos";
+#elif defined(__linux__)
+    return "linux";
+#else
+    return "unknown";
+#endif
+}
+
+// Writes the results as JSON, one scene per line so baselines can be read back simply
+inline void writeBench(std::ostream& out, const std::vector<BenchResult>& results, const Options& opts, size_t threads)
+{
+    const char* kernel;
+    sphereKernel<Real>(&kernel);
+
+    out << "{\n  \"machine\": {\"cpu\": " << jsonString(cpuName())
+        << ", \"hardware_threads\": " << std::thread::hardware_concurrency()
+        << ", \"os\": " << jsonString(osName())
+        << ", \"compiler\": " << jsonString(__VERSION__)
+        << ", \"precision\": \"" << (FLOAT_PRECISION ? "float" : "double") << "\""
+        << ", \"sphere_kernel\": " << jsonString(kernel) << "},\n";
+
+    out << "  \"settings\": {\"width\": " << BENCH_WIDTH << ", \"height\": " << BENCH_HEIGHT
+        << ", \"spp\": " << BENCH_SPP << ", \"depth\": " << BENCH_DEPTH << ", \"seed\": " << BENCH_SEED
+        << ", \"threads\": " << threads << ", \"sampler\": " << jsonString(opts.sampler)
+        << ", \"packets\": " << (opts.packets ? "true" : "false")
+        << ", \"wavefront\": " << (opts.wavefront ? "true" : "false") << "},\n";
+
+    out << "  \"scenes\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult& r = results[i];
+        out << "    {\"name\": " << jsonString(r.name) << ", \"objects\": " << r.objects
+            << ", \"build_ms\": " << r.build << ", \"render_ms\": " << r.render
+            << ", \"display_ms\": " << r.display << ", \"rays\": " << r.rays
+            << ", \"rays_per_path\": " << r.raysPerPath << ", \"mrays_per_s\": " << r.mrays() << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+// Reads the throughput of each scene from results written by writeBench
+inline bool readBaseline(const std::string& path, std::map<std::string, double>& mrays)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cerr << "ERROR: Cannot open baseline " << path << std::endl;
+        return false;
+    }
+
+    const std::string nameKey = "\"name\": \"", mraysKey = "\"mrays_per_s\": ";
+    std::string line;
+    while (std::getline(file, line))
+    {
+        const size_t name = line.find(nameKey);
+        const size_t value = line.find(mraysKey);
+        if (name == std::string::npos || value == std::string::npos) continue;
+        const size_t start = name + nameKey.size();
+        mrays[line.substr(start, line.find('"', start) - start)] = std::strtod(line.c_str() + value + mraysKey.size(), nullptr);
+    }
+
+    if (mrays.empty())
+    {
+        std::cerr << "ERROR: No results in baseline " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Reports each scene against the baseline, returning false if any has slowed past the tolerance
+inline bool compareBench(const std::vector<BenchResult>& results, const std::map<std::string, double>& baseline)
+{
+    bool passed = true;
+    for (const BenchResult& r : results)
+    {
+        auto found = baseline.find(r.name);
+        if (found == baseline.end() || found->second <= 0.0)
+        {
+            std::cerr << r.name << "\tnot in baseline" << std::endl;
+            continue;
+        }
+
+        const double change = r.mrays() / found->second - 1.0;
+        const bool slower = change < -BENCH_TOLERANCE;
+        std::cerr << r.name << "\t" << r.mrays() << " Mrays/s against " << found->second << "\t"
+                  << (change >= 0 ? "+" : "") << 100.0 * change << "%" << (slower ? "\tREGRESSION" : "") << std::endl;
+        passed = passed && !slower;
+    }
+    return passed;
+}
+
+#endif
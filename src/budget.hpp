@@ -0,0 +1,58 @@
+#ifndef BUDGET_H_
+#define BUDGET_H_
+
+#include <glm/glm.hpp>
+
+// Most a frame's width and height are divided by to keep to the budget
+static const int FRAME_SCALE_MAX = 4;
+
+// Most samples a pixel takes in one budgeted frame, unless --spp asks for more
+static const int FRAME_SPP_MAX = 64;
+
+// Weight a frame's measured cost carries against those before it
+static const double FRAME_SMOOTHING = 0.3;
+
+// Plans interactive frames to trace in about a target time, from what earlier ones cost
+// While the camera moves, resolution drops first and samples fill what time is left,
+// and once it stops frames go back to full resolution to refine
+class FrameBudget
+{ public:
+
+    // A target of 0 leaves every frame at full resolution and the given samples
+    FrameBudget(int width, int height, int samples, double target)
+        : fullWidth(width), fullHeight(height), most(glm::max(samples, FRAME_SPP_MAX)), target(target), spp(samples) { }
+
+    // The next frame's width and height are those of the window divided by the scale
+    int scale() const { return level; }
+    int samples() const { return spp; }
+
+    int width(int scale) const { return (fullWidth + scale - 1) / scale; }
+    int height(int scale) const { return (fullHeight + scale - 1) / scale; }
+
+    // Learns from a frame at the planned scale and samples, then plans the next
+    void finished(double seconds, bool moving)
+    {
+        if (target <= 0.0) return;
+        const double measured = seconds / (pixels(level) * spp);
+        cost = cost > 0.0 ? glm::mix(cost, measured, FRAME_SMOOTHING) : measured;
+
+        level = 1;
+        while (moving && level < FRAME_SCALE_MAX && cost * pixels(level) > target) ++level;
+        spp = glm::clamp(int(target / (cost * pixels(level))), 1, most);
+    }
+
+private:
+
+    int fullWidth, fullHeight;
+    int most;
+    double target;
+    int level = 1;
+    int spp;
+
+    // Seconds a sample of one pixel takes
+    double cost = 0.0;
+
+    double pixels(int scale) const { return double(width(scale)) * height(scale); }
+};
+
+#endif
@@ -0,0 +1,534 @@
+#ifndef BVH_H_
+#define BVH_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "aabb.hpp"
+#include "geometry.hpp"
+#include "profile.hpp"
+
+// Build parameters
+static const uint32_t BVH_BINS = 16;
+static const uint32_t BVH_LEAF_MAX = 4;
+static const double BVH_TRAVERSAL_COST = 1.0;
+
+// Below this depth only balanced splits are made, bounding the stack
+static const int BVH_SAH_DEPTH = 48;
+static const int BVH_STACK = 128;
+
+// Interior nodes have no count, their left child follows them in memory
+struct BVHNode
+{
+    AABB box;
+    uint32_t start; // First primitive of a leaf, or the right child
+    uint32_t count; // Primitives in a leaf, zero for interior nodes
+};
+
+// Binned SAH hierarchy over a list of primitive boxes
+class BVHTree
+{ public:
+
+    std::vector<BVHNode> nodes;
+
+    // Primitive indices in leaf order
+    std::vector<uint32_t> order;
+
+    BVHTree() { }
+
+    // Traversal reads nodes through a pointer, which a copy would leave on the original
+    BVHTree(const BVHTree&) = delete;
+    BVHTree& operator=(const BVHTree&) = delete;
+    BVHTree(BVHTree&&) = default;
+    BVHTree& operator=(BVHTree&&) = default;
+
+    // Leaves hold up to leafMax primitives, tested batch at a time
+    void build(const std::vector<AABB>& boxes, uint32_t leafMax = BVH_LEAF_MAX, uint32_t batch = 1)
+    {
+        this->leafMax = leafMax;
+        this->batch = batch;
+        nodes.clear();
+        order.resize(boxes.size());
+        adopt(nullptr, 0);
+        if (boxes.empty()) return;
+
+        PROFILE_SCOPE("bvh build");
+        std::vector<Vec3> centres(boxes.size());
+        for (uint32_t i = 0; i < boxes.size(); ++i)
+        {
+            order[i] = i;
+            centres[i] = boxes[i].centre();
+        }
+
+        nodes.reserve(boxes.size() * 2 / leafMax + 1);
+        split(boxes, centres, 0, boxes.size(), 0);
+        adopt(nodes.data(), nodes.size());
+    }
+
+    // Recomputes the boxes of a built tree after its primitives move, keeping its shape
+    // Far cheaper than a build, though the tree gets looser the further things move
+    void refit(const std::vector<AABB>& boxes)
+    {
+        // Children always follow their parent, so going backwards finishes them first
+        for (size_t i = nodes.size(); i-- > 0;)
+        {
+            BVHNode& node = nodes[i];
+            if (node.count)
+            {
+                node.box = AABB();
+                for (uint32_t j = node.start; j < node.start + node.count; ++j) node.box.grow(boxes[order[j]]);
+            }
+            else
+            {
+                node.box = nodes[i + 1].box;
+                node.box.grow(nodes[node.start].box);
+            }
+        }
+    }
+
+    // Traverses nodes stored elsewhere, such as in a mapped scene cache, which must outlive the tree
+    void adopt(const BVHNode* first, size_t count)
+    {
+        root = first;
+        nodeCount = count;
+    }
+
+    const BVHNode* data() const { return root; }
+    size_t size() const { return nodeCount; }
+
+    AABB bounds() const
+    {
+        return nodeCount ? root[0].box : AABB();
+    }
+
+    // Visits leaves front to back, skipping any further than the closest hit
+    // The leaf callback takes a range of order and shortens tMax on a hit
+    template <typename Leaf>
+    bool traverse(const Ray& ray, Real tMin, Real tMax, Leaf leaf) const
+    {
+        if (!nodeCount) return false;
+
+        const Vec3 inv = Real(1) / ray.dir;
+        uint32_t stack[BVH_STACK];
+        Real entry[BVH_STACK];
+        int top = 0;
+
+        Real tNear;
+        PROFILE_COUNT(BOX_TESTS);
+        if (!root[0].box.hit(ray, inv, tMin, tMax, tNear)) return false;
+
+        bool hasHit = false;
+        uint32_t index = 0;
+
+        while (true)
+        {
+            const BVHNode& node = root[index];
+
+            if (node.count)
+            {
+                if (leaf(node.start, node.count, tMax)) hasHit = true;
+            }
+            else
+            {
+                uint32_t near = index + 1;
+                uint32_t far = node.start;
+                Real tNearL, tNearR;
+                PROFILE_ADD(BOX_TESTS, 2);
+                bool hitL = root[near].box.hit(ray, inv, tMin, tMax, tNearL);
+                bool hitR = root[far].box.hit(ray, inv, tMin, tMax, tNearR);
+
+                if (hitL && hitR)
+                {
+                    if (tNearR < tNearL)
+                    {
+                        std::swap(near, far);
+                        std::swap(tNearL, tNearR);
+                    }
+                    stack[top] = far;
+                    entry[top++] = tNearR;
+                    index = near;
+                    continue;
+                }
+                if (hitL || hitR)
+                {
+                    index = hitL ? near : far;
+                    continue;
+                }
+            }
+
+            // Resume at the nearest postponed node that can still be hit
+            do
+            {
+                if (!top) return hasHit;
+                index = stack[--top];
+            }
+            while (entry[top] > tMax);
+        }
+    }
+
+    // Visits leaves until the leaf callback reports a hit, nearer child first but without
+    // sorting the rest, as shadow rays need any hit rather than the closest
+    template <typename Leaf>
+    bool any(const Ray& ray, Real tMin, Real tMax, Leaf leaf) const
+    {
+        if (!nodeCount) return false;
+
+        const Vec3 inv = Real(1) / ray.dir;
+        uint32_t stack[BVH_STACK];
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top)
+        {
+            const uint32_t index = stack[--top];
+            const BVHNode& node = root[index];
+            Real tNear;
+            PROFILE_COUNT(BOX_TESTS);
+            if (!node.box.hit(ray, inv, tMin, tMax, tNear)) continue;
+
+            if (node.count)
+            {
+                if (leaf(node.start, node.count)) return true;
+                continue;
+            }
+
+            // The child first along the ray's direction on the widest axis goes on top
+            uint32_t near = index + 1, far = node.start;
+            const Vec3 gap = root[far].box.centre() - root[near].box.centre();
+            const Vec3 size = glm::abs(gap);
+            const int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+            if ((gap[axis] < 0) != (ray.dir[axis] < 0)) std::swap(near, far);
+            stack[top++] = far;
+            stack[top++] = near;
+        }
+        return false;
+    }
+
+    // Visits every leaf that any active ray of the packet enters
+    // Children are ordered by the direction of the first active ray
+    template <typename Leaf>
+    void traverse(RayPacket& packet, Leaf leaf) const
+    {
+        if (!nodeCount || !packet.active) return;
+
+        int lead = 0;
+        while (!(packet.active >> lead & 1)) ++lead;
+        const Real dir[3] = { packet.dx[lead], packet.dy[lead], packet.dz[lead] };
+
+        uint32_t stack[BVH_STACK];
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top)
+        {
+            const uint32_t index = stack[--top];
+            const BVHNode& node = root[index];
+
+            // Boxes are tested when popped, against the latest tMax of each lane
+            PROFILE_COUNT(PACKET_BOX_TESTS);
+            uint32_t mask = packet.hit(node.box);
+            if (!mask) continue;
+
+            if (node.count)
+            {
+                leaf(node.start, node.count, mask);
+                continue;
+            }
+
+            uint32_t near = index + 1;
+            uint32_t far = node.start;
+            Vec3 gap = root[far].box.centre() - root[near].box.centre();
+            Vec3 size = glm::abs(gap);
+            int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+            if ((gap[axis] < 0) != (dir[axis] < 0)) std::swap(near, far);
+
+            stack[top++] = far;
+            stack[top++] = near;
+        }
+    }
+
+private:
+
+    uint32_t leafMax = BVH_LEAF_MAX;
+    uint32_t batch = 1;
+
+    // The nodes traversed, normally those built here
+    const BVHNode* root = nullptr;
+    size_t nodeCount = 0;
+
+    // Cost of testing n primitives, in batches
+    double cost(uint32_t n) const
+    {
+        return (n + batch - 1) / batch;
+    }
+
+    uint32_t split(const std::vector<AABB>& boxes, const std::vector<Vec3>& centres,
+                   uint32_t start, uint32_t count, int depth)
+    {
+        const uint32_t index = nodes.size();
+        nodes.push_back(BVHNode());
+
+        AABB box, centreBox;
+        for (uint32_t i = start; i < start + count; ++i)
+        {
+            box.grow(boxes[order[i]]);
+            centreBox.grow(centres[order[i]]);
+        }
+        nodes[index].box = box;
+        nodes[index].start = start;
+        nodes[index].count = count;
+
+        if (count <= 1) return index;
+
+        Vec3 extent = centreBox.hi - centreBox.lo;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+        // Every centre coincides, so no plane can separate them
+        if (extent[axis] <= 0.0 && count <= leafMax) return index;
+
+        uint32_t mid = start;
+        if (extent[axis] > 0.0 && depth < BVH_SAH_DEPTH)
+        {
+            double bestCost;
+            int bestAxis, bestBin;
+            findSplit(boxes, centres, centreBox, start, count, bestCost, bestAxis, bestBin);
+
+            // Splitting must beat intersecting everything here
+            if (bestCost >= cost(count) && count <= leafMax) return index;
+
+            const double lo = centreBox.lo[bestAxis];
+            const double scale = BVH_BINS / (centreBox.hi[bestAxis] - lo);
+            mid = std::partition(order.begin() + start, order.begin() + start + count, [&](uint32_t p)
+            {
+                return binOf(centres[p][bestAxis], lo, scale) < bestBin;
+            }) - order.begin();
+        }
+
+        // Degenerate or too deep, so halve by object count instead
+        if (mid == start || mid == start + count)
+        {
+            mid = start + count / 2;
+            std::nth_element(order.begin() + start, order.begin() + mid, order.begin() + start + count,
+                [&](uint32_t a, uint32_t b) { return centres[a][axis] < centres[b][axis]; });
+        }
+
+        split(boxes, centres, start, mid - start, depth + 1);
+        uint32_t right = split(boxes, centres, mid, start + count - mid, depth + 1);
+        nodes[index].start = right;
+        nodes[index].count = 0;
+        return index;
+    }
+
+    static int binOf(double centre, double lo, double scale)
+    {
+        return glm::min(int((centre - lo) * scale), int(BVH_BINS) - 1);
+    }
+
+    // Sweeps the bin boundaries of every axis for the cheapest split
+    void findSplit(const std::vector<AABB>& boxes, const std::vector<Vec3>& centres,
+                   const AABB& centreBox, uint32_t start, uint32_t count,
+                   double& bestCost, int& bestAxis, int& bestBin) const
+    {
+        bestCost = INF;
+        bestAxis = 0;
+        bestBin = 1;
+        double parentArea = 0.0;
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const double lo = centreBox.lo[axis];
+            const double width = centreBox.hi[axis] - lo;
+            if (width <= 0.0) continue;
+            const double scale = BVH_BINS / width;
+
+            AABB bins[BVH_BINS];
+            uint32_t counts[BVH_BINS] = { };
+            for (uint32_t i = start; i < start + count; ++i)
+            {
+                int b = binOf(centres[order[i]][axis], lo, scale);
+                bins[b].grow(boxes[order[i]]);
+                ++counts[b];
+            }
+
+            // Areas and counts of everything right of each boundary
+            double rightArea[BVH_BINS];
+            uint32_t rightCount[BVH_BINS];
+            AABB acc;
+            uint32_t n = 0;
+            for (int b = BVH_BINS - 1; b > 0; --b)
+            {
+                acc.grow(bins[b]);
+                n += counts[b];
+                rightArea[b] = acc.area();
+                rightCount[b] = n;
+            }
+            acc.grow(bins[0]);
+            parentArea = acc.area();
+
+            acc = AABB();
+            n = 0;
+            for (uint32_t b = 1; b < BVH_BINS; ++b)
+            {
+                acc.grow(bins[b - 1]);
+                n += counts[b - 1];
+                double splitCost = acc.area() * cost(n) + rightArea[b] * cost(rightCount[b]);
+                if (splitCost < bestCost)
+                {
+                    bestCost = splitCost;
+                    bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+
+        // Normalise into units of primitive intersections
+        if (parentArea > 0.0) bestCost = BVH_TRAVERSAL_COST + bestCost / parentArea;
+    }
+};
+
+// Acceleration structure over the contents of a Geometry
+class BVH: public Surface
+{ public:
+
+    std::vector<std::shared_ptr<Surface>> objects;
+    BVHTree tree;
+
+    // Objects without finite bounds, such as empty meshes, tested one by one
+    std::vector<uint32_t> unbounded;
+
+    BVH(const Geometry& geometry) : objects(geometry.objects)
+    {
+        rebuild();
+    }
+
+    // Follows objects that have moved, such as instances given new transforms
+    // Refitting keeps the tree as built, while rebuilding costs more and stays tight
+    void refit()
+    {
+        std::vector<AABB> boxes;
+        bool same = objectBounds(boxes) == unbounded.size();
+        for (uint32_t i : unbounded) same = same && !boxes[i].valid();
+
+        // An object gaining or losing its bounds changes what the tree holds
+        if (same) tree.refit(boxes);
+        else rebuild();
+    }
+
+    void rebuild()
+    {
+        std::vector<AABB> boxes;
+        objectBounds(boxes);
+
+        // Only bounded objects are built over, and the tree's order is then mapped from
+        // their place in that list back to their index in objects
+        std::vector<AABB> bounded;
+        std::vector<uint32_t> members;
+        unbounded.clear();
+        for (uint32_t i = 0; i < boxes.size(); ++i)
+        {
+            if (boxes[i].valid())
+            {
+                bounded.push_back(boxes[i]);
+                members.push_back(i);
+            }
+            else unbounded.push_back(i);
+        }
+        tree.build(bounded);
+        for (uint32_t& i : tree.order) i = members[i];
+    }
+
+    bool hit(const Ray& ray, Real tMin, Real tMax, RayHit& hit) const
+    {
+        RayHit tempHit;
+        Real nearest = tMax;
+        bool hasHit = false;
+        for (uint32_t i : unbounded)
+        {
+            if (objects[i]->hit(ray, tMin, nearest, tempHit))
+            {
+                hasHit = true;
+                nearest = tempHit.t;
+                hit = tempHit;
+            }
+        }
+
+        return tree.traverse(ray, tMin, nearest, [&](uint32_t start, uint32_t count, Real& closest)
+        {
+            bool hasHit = false;
+            for (uint32_t i = start; i < start + count; ++i)
+            {
+                if (objects[tree.order[i]]->hit(ray, tMin, closest, tempHit))
+                {
+                    hasHit = true;
+                    closest = tempHit.t;
+                    hit = tempHit;
+                }
+            }
+            return hasHit;
+        }) || hasHit;
+    }
+
+    bool occluded(const Ray& ray, Real tMin, Real tMax) const
+    {
+        for (uint32_t i : unbounded)
+        {
+            if (objects[i]->occluded(ray, tMin, tMax)) return true;
+        }
+
+        return tree.any(ray, tMin, tMax, [&](uint32_t start, uint32_t count)
+        {
+            for (uint32_t i = start; i < start + count; ++i)
+            {
+                if (objects[tree.order[i]]->occluded(ray, tMin, tMax)) return true;
+            }
+            return false;
+        });
+    }
+
+    uint32_t hitPacket(RayPacket& packet, RayHit* hits) const
+    {
+        uint32_t found = 0;
+        for (uint32_t i : unbounded) found |= objects[i]->hitPacket(packet, hits);
+
+        tree.traverse(packet, [&](uint32_t start, uint32_t count, uint32_t mask)
+        {
+            // Lanes that missed the leaf's box cannot hit what it holds
+            const uint32_t active = packet.active;
+            packet.active = mask;
+            for (uint32_t i = start; i < start + count; ++i)
+            {
+                found |= objects[tree.order[i]]->hitPacket(packet, hits);
+            }
+            packet.active = active;
+        });
+        return found;
+    }
+
+    bool bounds(AABB& box) const
+    {
+        box = tree.bounds();
+        return tree.size() > 0 && unbounded.empty();
+    }
+
+private:
+
+    // Fills a box per object, left empty for those without finite bounds, and returns
+    // how many of those there are
+    size_t objectBounds(std::vector<AABB>& boxes) const
+    {
+        boxes.assign(objects.size(), AABB());
+        size_t missing = 0;
+        for (size_t i = 0; i < objects.size(); ++i)
+        {
+            if (!objects[i]->bounds(boxes[i]) || !boxes[i].valid())
+            {
+                boxes[i] = AABB();
+                ++missing;
+            }
+        }
+        return missing;
+    }
+};
+
+#endif
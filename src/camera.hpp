@@ -8,7 +8,7 @@
 #include "ray.hpp"
 
 // Constants
-static const glm::dvec3 UP(0.0, 1.0, 0.0);
+static const Vec3 UP(0, 1, 0);
 static const double PITCH_MAX = 89.0;
 static const double FOV_MIN = 10.0;
 static const double FOV_MAX = 170.0;
@@ -17,45 +17,118 @@ static const double FAR = 1000.0;
 static const double ACC = 200.0;
 static const double SPEED_MAX = 20.0;
 static const double FRICTION = 0.0001;
+static const double SPEED_MIN = 0.01;
+static const double SENSITIVITY = 0.1;
 
 class Camera
 { public:
 
-    Camera(const glm::dvec3& position, const glm::dvec3& lookAt) : position(position)
+    Camera() { }
+
+    Camera(const Vec3& position, const Vec3& lookAt, Real aspect, Real vfov = VFOV) : position(position)
     {
-        const double theta = glm::radians(double(VFOV));
-        const double height = glm::tan(theta / 2.0) * 2.0;
-        const double width = height * WIN_W / WIN_H;
+        const Real theta = glm::radians(vfov);
+        planeH = glm::tan(theta / 2) * 2;
+        planeW = planeH * aspect;
 
         look = glm::normalize(position - lookAt);
         right = glm::normalize(glm::cross(UP, look));
         above = glm::normalize(glm::cross(look, right));
 
-        zont = width * right;
-        vert = height * above;
-        lowerLeft = position - (zont + vert) / 2.0 - look;
+        zont = planeW * right;
+        vert = planeH * above;
+        lowerLeft = position - (zont + vert) / Real(2) - look;
+
+        // Look points backwards, away from the view
+        pitch = glm::degrees(glm::asin(double(-look.y)));
+        yaw = glm::degrees(glm::atan(double(-look.x), double(look.z)));
+    }
+
+    // Accelerates along input, given as right, up and forward, and coasts to a stop under friction
+    void move(const glm::dvec3& input, double deltaTime)
+    {
+        const glm::dvec3 forward = -glm::dvec3(look);
+        glm::dvec3 push = input.x * glm::dvec3(right) + input.y * glm::dvec3(UP) + input.z * forward;
+        if (glm::dot(push, push) > 0.0) push = glm::normalize(push);
+
+        glm::dvec3 speed = glm::dvec3(velocity) + ACC * deltaTime * push;
+        speed *= glm::pow(FRICTION, deltaTime);
+        const double length = glm::length(speed);
+        if (length > SPEED_MAX) speed *= SPEED_MAX / length;
+
+        // Stopping outright lets the image converge again
+        if (length < SPEED_MIN) speed = glm::dvec3(0);
+        velocity = Vec3(speed);
+        if (velocity == Vec3(0)) return;
+
+        position += Vec3(speed * deltaTime);
+        lowerLeft = position - (zont + vert) / Real(2) - look;
     }
 
-    Ray getRay(const double& u, const double& v) const
+    // Turns by cursor movement in pixels, never looking straight up or down
+    void turn(double dx, double dy)
+    {
+        if (dx == 0.0 && dy == 0.0) return;
+        yaw += dx * SENSITIVITY;
+        pitch = glm::clamp(pitch - dy * SENSITIVITY, -PITCH_MAX, PITCH_MAX);
+
+        const double p = glm::radians(pitch), y = glm::radians(yaw);
+        look = -Vec3(glm::cos(p) * glm::sin(y), glm::sin(p), -glm::cos(p) * glm::cos(y));
+        right = glm::normalize(glm::cross(UP, look));
+        above = glm::normalize(glm::cross(look, right));
+
+        zont = planeW * right;
+        vert = planeH * above;
+        lowerLeft = position - (zont + vert) / Real(2) - look;
+    }
+
+    Ray getRay(Real u, Real v) const
     {
         return Ray(position, lowerLeft + u * zont + v * vert - position);
     }
 
+    const Vec3& origin() const { return position; }
+
+    // Where a direction from the camera crosses the image, in getRay's terms
+    // Returns false for directions behind the camera
+    bool project(const Vec3& dir, Real& u, Real& v) const
+    {
+        const Real along = -glm::dot(dir, look);
+        if (along <= 0) return false;
+        const Vec3 onPlane = dir / along + look + (zont + vert) / Real(2);
+        u = glm::dot(onPlane, zont) / glm::dot(zont, zont);
+        v = glm::dot(onPlane, vert) / glm::dot(vert, vert);
+        return true;
+    }
+
+    // Whether both cameras would produce the same rays
+    bool operator==(const Camera& other) const
+    {
+        return position == other.position && lowerLeft == other.lowerLeft
+            && zont == other.zont && vert == other.vert;
+    }
+
 private:
 
     // Kinematics
-    glm::dvec3 position;
-    glm::dvec3 velocity;
+    Vec3 position;
+    Vec3 velocity = Vec3(0);
+
+    // Degrees, with zero yaw looking along -z
+    double yaw = 0.0;
+    double pitch = 0.0;
 
     // Direction
-    glm::dvec3 look;
-    glm::dvec3 right;
-    glm::dvec3 above;
+    Vec3 look;
+    Vec3 right;
+    Vec3 above;
 
     // Raytracing
-    glm::dvec3 lowerLeft;
-    glm::dvec3 zont;
-    glm::dvec3 vert;
+    Vec3 lowerLeft;
+    Vec3 zont;
+    Vec3 vert;
+    Real planeW = 1;
+    Real planeH = 1;
 };
 
 #endif
@@ -11,11 +11,36 @@
 // Vertical sync
 #define VSYNC 1
 
+// Milliseconds each interactive frame aims to trace in, lowering resolution while the camera
+// moves and refining back to full once it stops, or 0 to trace every frame in full
+#define FRAME_TIME 33
+
 // Multisample anti-aliasing multiplier
 #define AA_X 1
 
-// Use a regular sampling pattern
-#define STRATIFY 1
+// Noise in displayed brightness a pixel must fall below to stop taking samples
+// 0 gives every pixel the same number
+#define ADAPT_THRESHOLD 0
+
+// Samples a pixel takes before its noise estimate is trusted
+#define ADAPT_MIN_SPP 16
+
+// Most samples adaptive rendering gives one pixel
+#define ADAPT_MAX_SPP 4096
+
+// Luminance below which noise is judged as if at this level, so black pixels can finish
+#define ADAPT_DARK 0.01
+
+// Denoiser passes over each finished image, guided by the albedo, normal and depth of first hits
+// Each pass doubles the reach of the filter, and 0 leaves images as traced
+#define DENOISE 0
+
+// Carry the accumulated image through camera moves, reprojected through first hits,
+// instead of starting again
+#define REPROJECT 1
+
+// Where samples land: random, sobol, halton or bluenoise
+#define SAMPLER "sobol"
 
 // Raw mouse input
 #define RAW_INPUT 1
@@ -23,10 +48,43 @@
 // Maximum diffuse tree depth
 #define RAY_DEPTH 50
 
+// Bounces before Russian roulette may end a path
+#define RR_DEPTH 3
+
+// Lowest chance of a path surviving Russian roulette
+#define RR_FLOOR 0.05
+
 // Lambertian diffuse
 #define LAMBERTIAN 1
 
 // Vertical field of view
 #define VFOV 20
 
+// Render threads, 0 uses every hardware thread
+#define THREADS 0
+
+// Width and height of the square tiles handed to each thread
+#define TILE_SIZE 32
+
+// Trace primary rays in coherent packets
+#define PACKETS 1
+
+// Advance a tile's paths together in stages instead of one by one
+#define WAVEFRONT 0
+
+// Trace in single precision, which doubles SIMD width and halves memory traffic
+// Left undefined here so a build can choose with -DFLOAT_PRECISION=1
+#ifndef FLOAT_PRECISION
+#define FLOAT_PRECISION 0
+#endif
+
+// Count and time the hot paths, printing a summary after rendering and allowing --trace
+// Costs a little even unused, so left off here for a build to choose with -DINSTRUMENT=1
+#ifndef INSTRUMENT
+#define INSTRUMENT 0
+#endif
+
+// Scene and sampling seed
+#define SEED 0
+
 #endif
@@ -0,0 +1,270 @@
+#ifndef DENOISE_H_
+#define DENOISE_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "kernels.hpp"
+#include "pool.hpp"
+#include "profile.hpp"
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al.), guided by the first hit of each pixel
+// Colour is divided by albedo before filtering and multiplied back after, so the filter
+// blurs lighting alone and leaves surface colours sharp
+
+// Spread of colour differences that still blend, halved each pass as the taps spread out
+static const float DENOISE_COLOUR = 0.6f;
+
+// Spread of normal differences that still blend, in units of the normals' length
+static const float DENOISE_NORMAL = 0.6f;
+
+// Spread of depth differences that still blend, relative to the pixel's depth per pixel of step
+static const float DENOISE_DEPTH = 0.05f;
+
+// Added to albedo before dividing by it, so black surfaces keep their light
+static const float DENOISE_ALBEDO_FLOOR = 0.01f;
+
+// Taps weighed below e^DENOISE_CUTOFF are dropped, which keeps the sums clear of denormals
+static const float DENOISE_CUTOFF = -30.0f;
+
+// Mean first hit features of every pixel, laid out as the image
+// Depth is zero where every sample saw the sky
+struct FeatureBuffers
+{
+    std::vector<float> albedo;
+    std::vector<float> normal;
+    std::vector<float> position;
+    std::vector<float> depth;
+
+    FeatureBuffers(size_t pixels = 0) : albedo(pixels * 3), normal(pixels * 3), position(pixels * 3), depth(pixels) { }
+};
+
+// e^x for x <= 0, close enough to weigh taps and the same in every kernel
+inline float denoiseExp(float x)
+{
+    if (x < DENOISE_CUTOFF) return 0.0f;
+    x *= 1.44269504f;
+    const float n = std::floor(x), f = x - n;
+    const float p = 1.0f + f * (0.693147f + f * (0.240227f + f * (0.0555041f + f * (0.00961813f + f * 0.00133336f))));
+    const int32_t bits = (int32_t(n) + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, 4);
+    return p * scale;
+}
+
+// One tap of the filter, applied across a run of pixels
+struct DenoiseTap
+{
+    // Colour r, g and b, normal x, y and z, and depth, each from the first pixel of the run
+    const float* planes[7];
+
+    // Where the tap lands relative to each pixel, within the planes
+    ptrdiff_t offset;
+
+    // Weighted colour and total weight, added to
+    float* sums[4];
+
+    float kernel;
+
+    // Negative inverse scales of the squared colour and normal distances and the relative depth
+    float colour, normal, depth;
+};
+
+// Adds the tap to pixels [start, end) of its run
+typedef void (*DenoiseKernel)(const DenoiseTap& tap, size_t start, size_t end);
+
+inline void denoiseTapScalar(const DenoiseTap& tap, size_t start, size_t end)
+{
+    const float* const* f = tap.planes;
+    const ptrdiff_t o = tap.offset;
+    for (size_t i = start; i < end; ++i)
+    {
+        const float r = f[0][i + o], g = f[1][i + o], b = f[2][i + o];
+        const float dr = f[0][i] - r, dg = f[1][i] - g, db = f[2][i] - b;
+        const float nx = f[3][i] - f[3][i + o], ny = f[4][i] - f[4][i + o], nz = f[5][i] - f[5][i + o];
+        const float dz = std::fabs(f[6][i] - f[6][i + o]) / (f[6][i] + 1e-3f);
+        const float w = tap.kernel * denoiseExp(tap.colour * (dr * dr + dg * dg + db * db)
+                                              + tap.normal * (nx * nx + ny * ny + nz * nz)
+                                              + tap.depth * dz);
+        tap.sums[0][i] += w * r;
+        tap.sums[1][i] += w * g;
+        tap.sums[2][i] += w * b;
+        tap.sums[3][i] += w;
+    }
+}
+
+#if KERNELS_X86
+
+// Eight pixels per step, finishing the run with the scalar kernel
+__attribute__((target("avx2,fma")))
+inline void denoiseTapAVX2(const DenoiseTap& tap, size_t start, size_t end)
+{
+    const float* const* f = tap.planes;
+    const ptrdiff_t o = tap.offset;
+    const __m256 colour = _mm256_set1_ps(tap.colour), normal = _mm256_set1_ps(tap.normal), depth = _mm256_set1_ps(tap.depth);
+    const __m256 kernel = _mm256_set1_ps(tap.kernel);
+    const __m256 sign = _mm256_set1_ps(-0.0f), floor = _mm256_set1_ps(1e-3f);
+
+    size_t i = start;
+    for (; i + 8 <= end; i += 8)
+    {
+        const __m256 r = _mm256_loadu_ps(f[0] + i + o), g = _mm256_loadu_ps(f[1] + i + o), b = _mm256_loadu_ps(f[2] + i + o);
+        const __m256 dr = _mm256_sub_ps(_mm256_loadu_ps(f[0] + i), r);
+        const __m256 dg = _mm256_sub_ps(_mm256_loadu_ps(f[1] + i), g);
+        const __m256 db = _mm256_sub_ps(_mm256_loadu_ps(f[2] + i), b);
+        const __m256 nx = _mm256_sub_ps(_mm256_loadu_ps(f[3] + i), _mm256_loadu_ps(f[3] + i + o));
+        const __m256 ny = _mm256_sub_ps(_mm256_loadu_ps(f[4] + i), _mm256_loadu_ps(f[4] + i + o));
+        const __m256 nz = _mm256_sub_ps(_mm256_loadu_ps(f[5] + i), _mm256_loadu_ps(f[5] + i + o));
+        const __m256 z = _mm256_loadu_ps(f[6] + i);
+        const __m256 dz = _mm256_div_ps(_mm256_andnot_ps(sign, _mm256_sub_ps(z, _mm256_loadu_ps(f[6] + i + o))),
+                                        _mm256_add_ps(z, floor));
+
+        const __m256 dc = _mm256_fmadd_ps(dr, dr, _mm256_fmadd_ps(dg, dg, _mm256_mul_ps(db, db)));
+        const __m256 dn = _mm256_fmadd_ps(nx, nx, _mm256_fmadd_ps(ny, ny, _mm256_mul_ps(nz, nz)));
+        __m256 x = _mm256_fmadd_ps(colour, dc, _mm256_fmadd_ps(normal, dn, _mm256_mul_ps(depth, dz)));
+
+        // As denoiseExp
+        const __m256 kept = _mm256_cmp_ps(x, _mm256_set1_ps(DENOISE_CUTOFF), _CMP_GE_OQ);
+        x = _mm256_mul_ps(_mm256_max_ps(x, _mm256_set1_ps(DENOISE_CUTOFF)), _mm256_set1_ps(1.44269504f));
+        const __m256 n = _mm256_floor_ps(x), t = _mm256_sub_ps(x, n);
+        __m256 p = _mm256_fmadd_ps(t, _mm256_set1_ps(0.00133336f), _mm256_set1_ps(0.00961813f));
+        p = _mm256_fmadd_ps(t, p, _mm256_set1_ps(0.0555041f));
+        p = _mm256_fmadd_ps(t, p, _mm256_set1_ps(0.240227f));
+        p = _mm256_fmadd_ps(t, p, _mm256_set1_ps(0.693147f));
+        p = _mm256_fmadd_ps(t, p, _mm256_set1_ps(1.0f));
+        const __m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+        const __m256 w = _mm256_and_ps(kept, _mm256_mul_ps(kernel, _mm256_mul_ps(p, _mm256_castsi256_ps(bits))));
+
+        _mm256_storeu_ps(tap.sums[0] + i, _mm256_fmadd_ps(w, r, _mm256_loadu_ps(tap.sums[0] + i)));
+        _mm256_storeu_ps(tap.sums[1] + i, _mm256_fmadd_ps(w, g, _mm256_loadu_ps(tap.sums[1] + i)));
+        _mm256_storeu_ps(tap.sums[2] + i, _mm256_fmadd_ps(w, b, _mm256_loadu_ps(tap.sums[2] + i)));
+        _mm256_storeu_ps(tap.sums[3] + i, _mm256_add_ps(w, _mm256_loadu_ps(tap.sums[3] + i)));
+    }
+    denoiseTapScalar(tap, i, end);
+}
+
+#endif
+
+// Picks the widest kernel this processor supports, once, as sphereKernel does
+inline DenoiseKernel denoiseKernel(const char** name = nullptr)
+{
+    static const char* chosen = "scalar";
+    static const DenoiseKernel kernel = []() -> DenoiseKernel
+    {
+#if KERNELS_X86
+        __builtin_cpu_init();
+        if (!std::getenv("RTIOW_SCALAR") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        {
+            chosen = "avx2";
+            return &denoiseTapAVX2;
+        }
+#endif
+        return &denoiseTapScalar;
+    }();
+    if (name) *name = chosen;
+    return kernel;
+}
+
+// Filters images in passes of 5x5 taps spaced 1, 2, 4... pixels apart, each row a task
+// Keeps its planes between calls, so filtering every frame allocates nothing
+class Denoiser
+{ public:
+
+    // Filters a linear RGB image into out, reaching 2^(passes + 1) pixels in each direction
+    void run(Pool& pool, size_t width, size_t height, const std::vector<float>& colour,
+             const FeatureBuffers& features, int passes, std::vector<float>& out)
+    {
+        PROFILE_SCOPE("denoise");
+        const size_t pixels = width * height;
+        planes.resize(pixels * 10);
+        sums.resize(pool.size() * width * 4);
+        out.resize(pixels * 3);
+
+        // Colour without albedo into planes 0 to 2, normal and depth into 3 to 6
+        pool.run(height, [&](size_t row, size_t)
+        {
+            for (size_t p = row * width; p < (row + 1) * width; ++p)
+            {
+                for (size_t k = 0; k < 3; ++k)
+                {
+                    plane(k)[p] = colour[p * 3 + k] / (features.albedo[p * 3 + k] + DENOISE_ALBEDO_FLOOR);
+                    plane(3 + k)[p] = features.normal[p * 3 + k];
+                }
+                plane(6)[p] = features.depth[p];
+            }
+        });
+
+        // Passes alternate between colour planes 0 to 2 and 7 to 9
+        static const float weights[5] = { 1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16 };
+        const DenoiseKernel kernel = denoiseKernel();
+        size_t from = 0;
+        for (int pass = 0; pass < passes; ++pass)
+        {
+            const ptrdiff_t step = ptrdiff_t(1) << pass;
+            const float spread = DENOISE_COLOUR / float(step);
+            const size_t to = from ? 0 : 7;
+
+            pool.run(height, [&](size_t row, size_t worker)
+            {
+                float* sum = &sums[worker * width * 4];
+                std::fill(sum, sum + width * 4, 0.0f);
+
+                DenoiseTap tap;
+                for (size_t k = 0; k < 3; ++k) tap.planes[k] = plane(from + k) + row * width;
+                for (size_t k = 3; k < 7; ++k) tap.planes[k] = plane(k) + row * width;
+                for (size_t k = 0; k < 4; ++k) tap.sums[k] = sum + k * width;
+                tap.colour = -1.0f / (spread * spread);
+                tap.normal = -1.0f / (DENOISE_NORMAL * DENOISE_NORMAL);
+                tap.depth = -1.0f / (DENOISE_DEPTH * step);
+
+                // Taps beyond the image are left out, and the weights normalised over the rest
+                for (int dy = -2; dy <= 2; ++dy)
+                {
+                    const ptrdiff_t y = ptrdiff_t(row) + dy * step;
+                    if (y < 0 || y >= ptrdiff_t(height)) continue;
+                    for (int dx = -2; dx <= 2; ++dx)
+                    {
+                        const ptrdiff_t x = dx * step;
+                        tap.offset = dy * step * ptrdiff_t(width) + x;
+                        tap.kernel = weights[dy + 2] * weights[dx + 2];
+                        kernel(tap, size_t(std::max(-x, ptrdiff_t(0))),
+                               size_t(std::max(ptrdiff_t(width) - std::max(x, ptrdiff_t(0)), ptrdiff_t(0))));
+                    }
+                }
+
+                for (size_t k = 0; k < 3; ++k)
+                {
+                    float* target = plane(to + k) + row * width;
+                    for (size_t i = 0; i < width; ++i) target[i] = tap.sums[k][i] / tap.sums[3][i];
+                }
+            });
+            from = to;
+        }
+
+        pool.run(height, [&](size_t row, size_t)
+        {
+            for (size_t p = row * width; p < (row + 1) * width; ++p)
+            {
+                for (size_t k = 0; k < 3; ++k)
+                {
+                    out[p * 3 + k] = plane(from + k)[p] * (features.albedo[p * 3 + k] + DENOISE_ALBEDO_FLOOR);
+                }
+            }
+        });
+    }
+
+private:
+
+    // Ten planes of one image each, one after another
+    AlignedVector<float> planes;
+
+    // Each worker's sums for the row it is filtering
+    std::vector<float> sums;
+
+    float* plane(size_t k) { return planes.data() + k * (planes.size() / 10); }
+};
+
+#endif
@@ -0,0 +1,732 @@
+#ifndef DISTRIBUTED_H_
+#define DISTRIBUTED_H_
+
+// Rendering shared between processes: a coordinator hands out jobs, each a share of one tile's
+// samples, to workers that join it over a socket, and merges the sums they send back
+// Messages go in the machine's own byte order, so every process must share an architecture
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "camera.hpp"
+#include "options.hpp"
+#include "pool.hpp"
+#include "renderer.hpp"
+#include "scene.hpp"
+
+// Seconds a worker keeps trying to reach its coordinator, which may still be starting
+static const double DIST_CONNECT_WAIT = 10.0;
+
+// Times longer than jobs take on average that a job may be out before a second worker is
+// given it too, in case the first has stalled
+static const double DIST_STRAGGLER = 4.0;
+
+// Seconds a finished coordinator waits for its workers to hang up
+static const double DIST_CLOSE_WAIT = 1.0;
+
+// Seconds a coordinator waits without any worker before giving up on the render
+static const double DIST_JOIN_WAIT = 60.0;
+
+enum MessageType : uint32_t { MSG_SETTINGS, MSG_REQUEST, MSG_JOBS, MSG_RESULT, MSG_DONE };
+
+struct MessageHeader
+{
+    uint32_t type;
+    uint32_t size;
+};
+
+// Leads each result, followed by the colour and feature sums of the job's tile
+struct ResultHeader
+{
+    Renderer::Job job;
+    uint32_t unused;
+    uint64_t paths;
+    uint64_t rays;
+};
+
+// Where to listen or connect, from unix:PATH or HOST:PORT
+// A missing host listens on every interface, or connects to this machine
+struct Address
+{
+    bool local = false;
+    std::string path;
+    std::string host;
+    std::string port;
+
+    bool parse(const std::string& text)
+    {
+        if (text.compare(0, 5, "unix:") == 0)
+        {
+            local = true;
+            path = text.substr(5);
+            return !path.empty() && path.size() < sizeof(sockaddr_un().sun_path);
+        }
+        const size_t colon = text.rfind(':');
+        if (colon == std::string::npos || colon + 1 == text.size()) return false;
+        host = text.substr(0, colon);
+        port = text.substr(colon + 1);
+        return true;
+    }
+
+    // Opens a listening socket, returning -1 on failure
+    int listen() const
+    {
+        if (local)
+        {
+            sockaddr_un name = unixName();
+            const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            unlink(path.c_str());
+            if (fd >= 0 && bind(fd, reinterpret_cast<sockaddr*>(&name), sizeof(name)) == 0 && ::listen(fd, 64) == 0) return fd;
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+
+        addrinfo* found = resolve(true);
+        for (addrinfo* a = found; a; a = a->ai_next)
+        {
+            const int fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd < 0) continue;
+            const int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            if (bind(fd, a->ai_addr, a->ai_addrlen) == 0 && ::listen(fd, 64) == 0)
+            {
+                freeaddrinfo(found);
+                return fd;
+            }
+            close(fd);
+        }
+        if (found) freeaddrinfo(found);
+        return -1;
+    }
+
+    // Makes one attempt to connect, returning -1 on failure
+    int connect() const
+    {
+        if (local)
+        {
+            sockaddr_un name = unixName();
+            const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&name), sizeof(name)) == 0) return fd;
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+
+        addrinfo* found = resolve(false);
+        for (addrinfo* a = found; a; a = a->ai_next)
+        {
+            const int fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd < 0) continue;
+            if (::connect(fd, a->ai_addr, a->ai_addrlen) == 0)
+            {
+                freeaddrinfo(found);
+                return fd;
+            }
+            close(fd);
+        }
+        if (found) freeaddrinfo(found);
+        return -1;
+    }
+
+    // Removes what listening left behind
+    void release() const
+    {
+        if (local) unlink(path.c_str());
+    }
+
+private:
+
+    sockaddr_un unixName() const
+    {
+        sockaddr_un name;
+        std::memset(&name, 0, sizeof(name));
+        name.sun_family = AF_UNIX;
+        std::strncpy(name.sun_path, path.c_str(), sizeof(name.sun_path) - 1);
+        return name;
+    }
+
+    addrinfo* resolve(bool passive) const
+    {
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = passive ? AI_PASSIVE : 0;
+        addrinfo* found = nullptr;
+        if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found) != 0) return nullptr;
+        return found;
+    }
+};
+
+// A connected stream socket carrying whole messages, closed when dropped
+class Connection
+{ public:
+
+    explicit Connection(int fd) : fd(fd)
+    {
+        // Requests are small and each waits on its reply
+        const int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+
+    ~Connection() { close(fd); }
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    int handle() const { return fd; }
+
+    bool send(MessageType type, const void* data, size_t size)
+    {
+        const MessageHeader header{ type, uint32_t(size) };
+        return write(&header, sizeof(header)) && write(data, size);
+    }
+
+    // Waits for a whole message
+    bool receive(MessageType& type, std::vector<char>& payload)
+    {
+        MessageHeader header;
+        if (!read(&header, sizeof(header))) return false;
+        type = MessageType(header.type);
+        payload.resize(header.size);
+        return read(payload.data(), payload.size());
+    }
+
+    // Reads whatever has arrived without waiting, for next to take whole messages from
+    // Returns false once the other end has hung up or failed
+    bool gather()
+    {
+        char block[1 << 16];
+        while (true)
+        {
+            const ssize_t got = recv(fd, block, sizeof(block), MSG_DONTWAIT);
+            if (got > 0) inbox.insert(inbox.end(), block, block + got);
+            else if (got < 0 && errno == EINTR) continue;
+            else return got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+
+    // Bytes the message being gathered will take in all, or 0 before its header has arrived
+    size_t expected() const
+    {
+        if (inbox.size() < sizeof(MessageHeader)) return 0;
+        MessageHeader header;
+        std::memcpy(&header, inbox.data(), sizeof(header));
+        return sizeof(header) + header.size;
+    }
+
+    // Takes the next whole message gathered, returning false if there is none yet
+    bool next(MessageType& type, std::vector<char>& payload)
+    {
+        const size_t size = expected();
+        if (!size || inbox.size() < size) return false;
+        MessageHeader header;
+        std::memcpy(&header, inbox.data(), sizeof(header));
+        type = MessageType(header.type);
+        payload.assign(inbox.begin() + sizeof(header), inbox.begin() + size);
+        inbox.erase(inbox.begin(), inbox.begin() + size);
+        return true;
+    }
+
+private:
+
+    int fd;
+
+    // Bytes gathered but not yet taken as messages
+    std::vector<char> inbox;
+
+    bool write(const void* data, size_t size)
+    {
+#ifdef MSG_NOSIGNAL
+        const int flags = MSG_NOSIGNAL;
+#else
+        const int flags = 0;
+#endif
+        const char* at = static_cast<const char*>(data);
+        while (size)
+        {
+            const ssize_t sent = ::send(fd, at, size, flags);
+            if (sent <= 0) return false;
+            at += sent;
+            size -= sent;
+        }
+        return true;
+    }
+
+    bool read(void* data, size_t size)
+    {
+        char* at = static_cast<char*>(data);
+        while (size)
+        {
+            const ssize_t got = recv(fd, at, size, 0);
+            if (got <= 0) return false;
+            at += got;
+            size -= got;
+        }
+        return true;
+    }
+};
+
+// Splits a render into jobs, serves them to whichever workers join, and merges the results
+// Jobs of a dead worker go back in the queue, and those of a stalled one are handed out again,
+// the first result to arrive being kept
+// Each tile's jobs are merged in sample order, so the image is the same however work was shared
+class Coordinator
+{ public:
+
+    Coordinator(Renderer& renderer, const Options& opts)
+        : renderer(renderer), opts(opts), pending(renderer.tileCount()), merged(renderer.tileCount())
+    {
+        const uint32_t samples = opts.samples;
+        const uint32_t chunk = opts.jobSamples ? glm::min(uint32_t(opts.jobSamples), samples) : samples;
+        for (uint32_t first = 0; first < samples; first += chunk)
+        {
+            for (size_t tile = 0; tile < renderer.tileCount(); ++tile)
+            {
+                JobState state;
+                state.job = Renderer::Job{ uint32_t(tile), first, glm::min(chunk, samples - first) };
+                jobs.push_back(state);
+                queue.push_back(jobs.size() - 1);
+            }
+        }
+
+        for (const std::string& arg : opts.arguments()) settings.insert(settings.end(), arg.c_str(), arg.c_str() + arg.size() + 1);
+
+        // The biggest message a worker may send is the result of the biggest tile
+        for (size_t tile = 0; tile < renderer.tileCount(); ++tile)
+        {
+            const Renderer::Tile t = renderer.tileAt(tile);
+            const size_t pixels = (t.x1 - t.x0) * (t.y1 - t.y0);
+            largest = std::max(largest, sizeof(MessageHeader) + sizeof(ResultHeader)
+                                        + pixels * (3 * sizeof(double) + Renderer::FEATURE_SUMS * sizeof(float)));
+        }
+    }
+
+    ~Coordinator()
+    {
+        if (listener < 0) return;
+        close(listener);
+        address.release();
+    }
+
+    Coordinator(const Coordinator&) = delete;
+    Coordinator& operator=(const Coordinator&) = delete;
+
+    size_t jobCount() const { return jobs.size(); }
+    uint32_t workersSeen() const { return joined; }
+
+    // Opens the address, returning false if it cannot be used
+    // Workers that connect before run are held in the backlog until it starts
+    bool listen()
+    {
+        if (!address.parse(opts.serve))
+        {
+            std::cerr << "ERROR: Bad address " << opts.serve << ", expected unix:PATH or HOST:PORT" << std::endl;
+            return false;
+        }
+        listener = address.listen();
+        if (listener < 0)
+        {
+            std::cerr << "ERROR: Cannot listen on " << opts.serve << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Serves until every job is merged, returning false if no worker is left for DIST_JOIN_WAIT
+    bool run()
+    {
+        std::cerr << "Serving " << jobs.size() << " jobs on " << opts.serve << std::endl;
+
+        auto reported = std::chrono::steady_clock::now();
+        auto alone = reported;
+        while (finished < jobs.size())
+        {
+            std::vector<pollfd> fds(1, pollfd{ listener, POLLIN, 0 });
+            for (const Peer& peer : peers) fds.push_back(pollfd{ peer.link->handle(), POLLIN, 0 });
+            poll(fds.data(), fds.size(), 250);
+
+            if (fds[0].revents & POLLIN) welcome(accept(listener, nullptr, nullptr));
+            for (size_t i = 0; i < peers.size(); ++i)
+            {
+                if (fds[i + 1].revents && !serve(peers[i])) peers[i].dead = true;
+            }
+            for (Peer& peer : peers)
+            {
+                if (peer.dead) leave(peer);
+            }
+            peers.erase(std::remove_if(peers.begin(), peers.end(), [](const Peer& p) { return p.dead; }), peers.end());
+            for (Peer& peer : peers)
+            {
+                if (peer.wanted && !hand(peer)) peer.dead = true;
+            }
+
+            const auto now = std::chrono::steady_clock::now();
+            if (!peers.empty()) alone = now;
+            else if (std::chrono::duration<double>(now - alone).count() > DIST_JOIN_WAIT)
+            {
+                std::cerr << "ERROR: No workers for " << DIST_JOIN_WAIT << " seconds, with "
+                          << finished << " of " << jobs.size() << " jobs merged" << std::endl;
+                return false;
+            }
+
+            if (std::chrono::duration<double>(now - reported).count() >= 1.0)
+            {
+                reported = now;
+                std::cerr << "Merged " << finished << " of " << jobs.size() << " jobs, " << peers.size() << " workers" << std::endl;
+            }
+        }
+
+        // Workers still busy with a duplicate get DONE when they next ask, so until they have all
+        // hung up, or DIST_CLOSE_WAIT has passed, their messages are read and dropped
+        // Closing on unread data could reset a connection and lose the DONE waiting in it
+        for (Peer& peer : peers)
+        {
+            peer.link->send(MSG_DONE, nullptr, 0);
+            shutdown(peer.link->handle(), SHUT_WR);
+        }
+        const auto closing = std::chrono::steady_clock::now();
+        while (!peers.empty() && std::chrono::duration<double>(std::chrono::steady_clock::now() - closing).count() < DIST_CLOSE_WAIT)
+        {
+            std::vector<pollfd> fds;
+            for (const Peer& peer : peers) fds.push_back(pollfd{ peer.link->handle(), POLLIN, 0 });
+            poll(fds.data(), fds.size(), 100);
+            for (size_t i = 0; i < peers.size(); ++i)
+            {
+                char drained[4096];
+                if (fds[i].revents && recv(fds[i].fd, drained, sizeof(drained), 0) <= 0) peers[i].dead = true;
+            }
+            peers.erase(std::remove_if(peers.begin(), peers.end(), [](const Peer& p) { return p.dead; }), peers.end());
+        }
+        peers.clear();
+        return true;
+    }
+
+private:
+
+    struct JobState
+    {
+        Renderer::Job job;
+        int holders = 0;
+        bool done = false;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    struct Peer
+    {
+        std::unique_ptr<Connection> link;
+        uint32_t id;
+        std::vector<size_t> held;
+        uint32_t wanted = 0;
+        bool dead = false;
+    };
+
+    Renderer& renderer;
+    const Options& opts;
+    std::vector<char> settings;
+    size_t largest = 0;
+
+    Address address;
+    int listener = -1;
+
+    std::vector<JobState> jobs;
+    std::deque<size_t> queue;
+    size_t finished = 0;
+    double jobTime = 0.0;
+
+    // Results waiting for a tile's earlier samples, and the first sample each tile needs next
+    std::vector<std::map<uint32_t, Renderer::JobResult>> pending;
+    std::vector<uint32_t> merged;
+
+    std::vector<Peer> peers;
+    uint32_t joined = 0;
+
+    void welcome(int fd)
+    {
+        if (fd < 0) return;
+        Peer peer;
+        peer.link.reset(new Connection(fd));
+        peer.id = ++joined;
+        if (!peer.link->send(MSG_SETTINGS, settings.data(), settings.size())) return;
+        std::cerr << "Worker " << peer.id << " joined" << std::endl;
+        peers.push_back(std::move(peer));
+    }
+
+    // Puts a lost worker's jobs back in the queue, unless another worker has them too
+    void leave(Peer& peer)
+    {
+        size_t returned = 0;
+        for (size_t j : peer.held)
+        {
+            if (jobs[j].done || --jobs[j].holders) continue;
+            queue.push_front(j);
+            ++returned;
+        }
+        peer.held.clear();
+        std::cerr << "Worker " << peer.id << " left, " << returned << " jobs back in the queue" << std::endl;
+    }
+
+    // Handles the whole messages a worker has sent, without waiting on the rest of one
+    // partly sent, so a worker stalling mid message holds up nothing but its own jobs
+    bool serve(Peer& peer)
+    {
+        const bool open = peer.link->gather();
+        if (peer.link->expected() > largest)
+        {
+            std::cerr << "ERROR: Worker " << peer.id << " sent a message too big to be a result" << std::endl;
+            return false;
+        }
+
+        MessageType type;
+        std::vector<char> payload;
+        while (peer.link->next(type, payload))
+        {
+            if (type == MSG_REQUEST && payload.size() == sizeof(uint32_t))
+            {
+                std::memcpy(&peer.wanted, payload.data(), sizeof(uint32_t));
+                continue;
+            }
+            if (type == MSG_RESULT && payload.size() >= sizeof(ResultHeader))
+            {
+                if (!take(peer, payload)) return false;
+                continue;
+            }
+
+            std::cerr << "ERROR: Worker " << peer.id << " sent a bad message" << std::endl;
+            return false;
+        }
+        return open;
+    }
+
+    // Gives a waiting worker as many jobs as it asked for on different tiles, queued ones first
+    // and then any that have been out too long, returning false if it cannot be reached
+    bool hand(Peer& peer)
+    {
+        std::vector<Renderer::Job> batch;
+        std::vector<uint8_t> taken(renderer.tileCount());
+        for (auto it = queue.begin(); it != queue.end() && batch.size() < peer.wanted; )
+        {
+            JobState& state = jobs[*it];
+            if (state.done) it = queue.erase(it);
+            else if (taken[state.job.tile]) ++it;
+            else
+            {
+                taken[state.job.tile] = 1;
+                give(peer, *it, batch);
+                it = queue.erase(it);
+            }
+        }
+
+        // Stragglers, oldest first, once there are jobs to judge them by
+        if (batch.empty() && finished)
+        {
+            const auto now = std::chrono::steady_clock::now();
+            std::vector<size_t> late;
+            for (size_t j = 0; j < jobs.size(); ++j)
+            {
+                const JobState& state = jobs[j];
+                const double out = std::chrono::duration<double>(now - state.start).count();
+                if (!state.done && state.holders == 1 && out > DIST_STRAGGLER * jobTime / finished
+                    && std::find(peer.held.begin(), peer.held.end(), j) == peer.held.end())
+                {
+                    late.push_back(j);
+                }
+            }
+            std::sort(late.begin(), late.end(), [&](size_t a, size_t b) { return jobs[a].start < jobs[b].start; });
+            for (size_t j : late)
+            {
+                if (batch.size() == peer.wanted) break;
+                if (taken[jobs[j].job.tile]) continue;
+                taken[jobs[j].job.tile] = 1;
+                give(peer, j, batch);
+            }
+        }
+
+        if (batch.empty()) return true;
+        peer.wanted = 0;
+        return peer.link->send(MSG_JOBS, batch.data(), batch.size() * sizeof(Renderer::Job));
+    }
+
+    void give(Peer& peer, size_t j, std::vector<Renderer::Job>& batch)
+    {
+        JobState& state = jobs[j];
+        if (!state.holders++) state.start = std::chrono::steady_clock::now();
+        peer.held.push_back(j);
+        batch.push_back(state.job);
+    }
+
+    // Keeps the first result for each job, merging every tile's jobs in sample order
+    bool take(Peer& peer, const std::vector<char>& payload)
+    {
+        ResultHeader header;
+        std::memcpy(&header, payload.data(), sizeof(header));
+        const Renderer::Job& job = header.job;
+        auto held = std::find_if(peer.held.begin(), peer.held.end(), [&](size_t j)
+        {
+            return jobs[j].job.tile == job.tile && jobs[j].job.first == job.first;
+        });
+        if (held == peer.held.end())
+        {
+            std::cerr << "ERROR: Worker " << peer.id << " sent a job it was not given" << std::endl;
+            return false;
+        }
+
+        const Renderer::Tile t = renderer.tileAt(job.tile);
+        const size_t pixels = (t.x1 - t.x0) * (t.y1 - t.y0);
+        const size_t colourBytes = pixels * 3 * sizeof(double);
+        const size_t featureBytes = pixels * Renderer::FEATURE_SUMS * sizeof(float);
+        if (payload.size() != sizeof(header) + colourBytes + featureBytes)
+        {
+            std::cerr << "ERROR: Worker " << peer.id << " sent a result of the wrong size" << std::endl;
+            return false;
+        }
+
+        JobState& state = jobs[*held];
+        peer.held.erase(held);
+        --state.holders;
+        if (state.done) return true;
+        state.done = true;
+        ++finished;
+        jobTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - state.start).count();
+
+        Renderer::JobResult& result = pending[job.tile][job.first];
+        result.job = job;
+        result.stats.paths = header.paths;
+        result.stats.rays = header.rays;
+        result.colour.resize(pixels * 3);
+        result.features.resize(pixels * Renderer::FEATURE_SUMS);
+        std::memcpy(result.colour.data(), payload.data() + sizeof(header), colourBytes);
+        std::memcpy(result.features.data(), payload.data() + sizeof(header) + colourBytes, featureBytes);
+
+        auto& waiting = pending[job.tile];
+        for (auto next = waiting.find(merged[job.tile]); next != waiting.end(); next = waiting.find(merged[job.tile]))
+        {
+            renderer.addJob(next->second);
+            merged[job.tile] += next->second.job.count;
+            waiting.erase(next);
+        }
+        return true;
+    }
+};
+
+// Takes jobs from a coordinator, renders them on the pool and sends back their sums
+class Worker
+{ public:
+
+    // Connects, retrying while the coordinator starts, and takes its settings into opts
+    bool join(Options& opts)
+    {
+        Address address;
+        if (!address.parse(opts.join))
+        {
+            std::cerr << "ERROR: Bad address " << opts.join << ", expected unix:PATH or HOST:PORT" << std::endl;
+            return false;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        int fd;
+        while ((fd = address.connect()) < 0)
+        {
+            if (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() > DIST_CONNECT_WAIT)
+            {
+                std::cerr << "ERROR: Cannot reach a coordinator on " << opts.join << std::endl;
+                return false;
+            }
+            usleep(100000);
+        }
+        link.reset(new Connection(fd));
+
+        MessageType type;
+        std::vector<char> payload;
+        if (!link->receive(type, payload) || type != MSG_SETTINGS || payload.empty() || payload.back() != '\0')
+        {
+            std::cerr << "ERROR: No settings from the coordinator" << std::endl;
+            return false;
+        }
+
+        std::vector<char*> args(1, const_cast<char*>("launch"));
+        for (size_t at = 0; at < payload.size(); at += std::strlen(&payload[at]) + 1) args.push_back(&payload[at]);
+        if (!opts.parse(args.size(), args.data()))
+        {
+            std::cerr << "ERROR: Cannot use the coordinator's settings" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Renders jobs until the coordinator has no more, returning false if it was lost
+    bool run(Pool& pool, Renderer& renderer, const Camera& cam, const Scene& scene, const Options& opts)
+    {
+        std::vector<Renderer::Job> jobs;
+        std::vector<Renderer::JobResult> results;
+        std::vector<char> message;
+        size_t rendered = 0;
+        while (true)
+        {
+            const uint32_t wanted = pool.size();
+            MessageType type;
+            std::vector<char> payload;
+            link->send(MSG_REQUEST, &wanted, sizeof(wanted));
+            if (!link->receive(type, payload)) return lost();
+            if (type == MSG_DONE)
+            {
+                std::cerr << "Rendered " << rendered << " jobs" << std::endl;
+                return true;
+            }
+            if (type != MSG_JOBS || payload.size() % sizeof(Renderer::Job)) return lost();
+
+            jobs.resize(payload.size() / sizeof(Renderer::Job));
+            std::memcpy(jobs.data(), payload.data(), payload.size());
+            for (const Renderer::Job& job : jobs)
+            {
+                if (job.tile < renderer.tileCount()) continue;
+                std::cerr << "ERROR: The coordinator sent a tile outside the image" << std::endl;
+                return false;
+            }
+            renderer.renderJobs(pool, cam, scene, opts, jobs, results);
+
+            for (const Renderer::JobResult& result : results)
+            {
+                const ResultHeader header{ result.job, 0, result.stats.paths, result.stats.rays };
+                const size_t colourBytes = result.colour.size() * sizeof(double);
+                message.resize(sizeof(header) + colourBytes + result.features.size() * sizeof(float));
+                std::memcpy(message.data(), &header, sizeof(header));
+                std::memcpy(message.data() + sizeof(header), result.colour.data(), colourBytes);
+                std::memcpy(message.data() + sizeof(header) + colourBytes, result.features.data(), result.features.size() * sizeof(float));
+                // A coordinator that has hung up may have left DONE to be read
+                if (!link->send(MSG_RESULT, message.data(), message.size())) break;
+            }
+            rendered += jobs.size();
+        }
+    }
+
+private:
+
+    std::unique_ptr<Connection> link;
+
+    static bool lost()
+    {
+        std::cerr << "ERROR: Lost the coordinator" << std::endl;
+        return false;
+    }
+};
+
+#endif
+
+#endif
@@ -16,11 +16,11 @@ class Geometry: public Surface
     void clear() { objects.clear(); }
     void add(std::shared_ptr<Surface> object) { objects.push_back(object); }
 
-    bool hit(const Ray& r, double tMin, double tMax, RayHit& hit) const
+    bool hit(const Ray& r, Real tMin, Real tMax, RayHit& hit) const
     {
         RayHit tempHit;
         bool hasHit = false;
-        double closest_so_far = tMax;
+        Real closest_so_far = tMax;
 
         for (const auto& object : objects)
         {
@@ -34,6 +34,34 @@ class Geometry: public Surface
 
         return hasHit;
     }
+
+    bool occluded(const Ray& r, Real tMin, Real tMax) const
+    {
+        for (const auto& object : objects)
+        {
+            if (object->occluded(r, tMin, tMax)) return true;
+        }
+        return false;
+    }
+
+    uint32_t hitPacket(RayPacket& packet, RayHit* hits) const
+    {
+        uint32_t mask = 0;
+        for (const auto& object : objects) mask |= object->hitPacket(packet, hits);
+        return mask;
+    }
+
+    bool bounds(AABB& box) const
+    {
+        box = AABB();
+        for (const auto& object : objects)
+        {
+            AABB objectBox;
+            if (!object->bounds(objectBox)) return false;
+            box.grow(objectBox);
+        }
+        return !objects.empty();
+    }
 };
 
 #endif
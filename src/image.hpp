@@ -0,0 +1,260 @@
+#ifndef IMAGE_H_
+#define IMAGE_H_
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Images are linear RGB floats with the bottom row first, as in the texture
+
+// Gamma corrects and quantises one linear channel for display
+inline uint8_t toDisplay(float linear)
+{
+    return uint8_t(glm::sqrt(glm::clamp(linear, 0.0f, 1.0f)) * 255.999f);
+}
+
+// Converts a whole image for display
+inline void toDisplay(const std::vector<float>& linear, std::vector<uint8_t>& bytes)
+{
+    bytes.resize(linear.size());
+    for (size_t i = 0; i < linear.size(); ++i) bytes[i] = toDisplay(linear[i]);
+}
+
+// Converts the pixels of a rectangle for display, into four byte pixels laid out as the whole image
+inline void toDisplay(const std::vector<float>& linear, int width, int x0, int y0, int x1, int y1, uint8_t* rgba)
+{
+    for (int y = y0; y < y1; ++y)
+    {
+        for (int x = x0; x < x1; ++x)
+        {
+            const size_t p = size_t(y) * width + x;
+            for (int k = 0; k < 3; ++k) rgba[p * 4 + k] = toDisplay(linear[p * 3 + k]);
+            rgba[p * 4 + 3] = 255;
+        }
+    }
+}
+
+// Binary PPM, rows written top to bottom
+inline void writePPM(std::ostream& out, int width, int height, const std::vector<float>& linear)
+{
+    out << "P6\n" << width << " " << height << "\n255\n";
+    std::vector<char> row(width * 3);
+    for (int y = height - 1; y >= 0; --y)
+    {
+        for (int i = 0; i < width * 3; ++i) row[i] = toDisplay(linear[y * width * 3 + i]);
+        out.write(row.data(), row.size());
+    }
+}
+
+// Portable float map, which keeps the full linear range
+inline void writePFM(std::ostream& out, int width, int height, const std::vector<float>& linear)
+{
+    // A negative scale marks little endian data
+    out << "PF\n" << width << " " << height << "\n-1.0\n";
+    std::vector<float> row(width * 3);
+    for (int y = 0; y < height; ++y)
+    {
+        for (int i = 0; i < width * 3; ++i)
+        {
+            float f = linear[y * width * 3 + i];
+            uint32_t bits;
+            std::memcpy(&bits, &f, 4);
+            uint8_t* b = reinterpret_cast<uint8_t*>(&row[i]);
+            for (int k = 0; k < 4; ++k) b[k] = bits >> (8 * k);
+        }
+        out.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+    }
+}
+
+// Reads a colour PFM, such as one written by writePFM
+inline bool loadPFM(const std::string& path, int& width, int& height, std::vector<float>& linear)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "ERROR: Cannot open " << path << std::endl;
+        return false;
+    }
+
+    std::string magic;
+    double scale;
+    file >> magic >> width >> height >> scale;
+    file.get();
+    if (!file || magic != "PF" || width < 1 || height < 1 || scale == 0.0)
+    {
+        std::cerr << "ERROR: Not a colour PFM " << path << std::endl;
+        return false;
+    }
+
+    // The sign of the scale gives the byte order
+    linear.resize(size_t(width) * height * 3);
+    std::vector<uint8_t> bytes(linear.size() * 4);
+    if (!file.read(reinterpret_cast<char*>(bytes.data()), bytes.size()))
+    {
+        std::cerr << "ERROR: Truncated PFM " << path << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < linear.size(); ++i)
+    {
+        uint32_t bits = 0;
+        for (int k = 0; k < 4; ++k)
+        {
+            const int shift = scale < 0.0 ? 8 * k : 8 * (3 - k);
+            bits |= uint32_t(bytes[i * 4 + k]) << shift;
+        }
+        std::memcpy(&linear[i], &bits, 4);
+    }
+    return true;
+}
+
+// Uncompressed PNG, streamed as stored deflate blocks a row at a time
+class PNGWriter
+{ public:
+
+    PNGWriter(std::ostream& out) : out(out) { }
+
+    void write(int width, int height, const std::vector<float>& linear)
+    {
+        out.write("\x89PNG\r\n\x1a\n", 8);
+
+        // 8 bit RGB, no interlacing
+        std::string header;
+        put32(header, width);
+        put32(header, height);
+        header += std::string("\x08\x02\x00\x00\x00", 5);
+        chunk("IHDR", header);
+
+        // Zlib header for a stream without compression
+        data = "\x78\x01";
+        adlerA = 1;
+        adlerB = 0;
+
+        std::string row(width * 3 + 1, '\0');
+        for (int y = height - 1; y >= 0; --y)
+        {
+            // Filter type 0 leaves the scanline as is
+            row[0] = 0;
+            for (int i = 0; i < width * 3; ++i) row[i + 1] = toDisplay(linear[y * width * 3 + i]);
+            deflate(row, false);
+        }
+        deflate("", true);
+
+        uint32_t adler = adlerB << 16 | adlerA;
+        put32(data, adler);
+        flush();
+        chunk("IEND", "");
+    }
+
+private:
+
+    std::ostream& out;
+    std::string data;
+    uint32_t adlerA, adlerB;
+
+    static void put32(std::string& s, uint32_t v)
+    {
+        for (int k = 3; k >= 0; --k) s += char(v >> (8 * k));
+    }
+
+    static uint32_t crc(const std::string& bytes)
+    {
+        static uint32_t table[256];
+        static bool ready = false;
+        if (!ready)
+        {
+            for (uint32_t n = 0; n < 256; ++n)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                table[n] = c;
+            }
+            ready = true;
+        }
+
+        uint32_t c = 0xFFFFFFFFu;
+        for (unsigned char b : bytes) c = table[(c ^ b) & 0xFF] ^ (c >> 8);
+        return c ^ 0xFFFFFFFFu;
+    }
+
+    void chunk(const std::string& type, const std::string& body)
+    {
+        std::string length;
+        put32(length, body.size());
+        std::string tail;
+        put32(tail, crc(type + body));
+        out << length << type << body << tail;
+    }
+
+    // Appends stored blocks, which hold at most 65535 bytes each
+    void deflate(const std::string& bytes, bool last)
+    {
+        size_t at = 0;
+        do
+        {
+            size_t n = std::min<size_t>(bytes.size() - at, 65535);
+            bool final = last && at + n == bytes.size();
+            data += char(final ? 1 : 0);
+            data += char(n & 0xFF);
+            data += char(n >> 8);
+            data += char(~n & 0xFF);
+            data += char((~n >> 8) & 0xFF);
+            data.append(bytes, at, n);
+            at += n;
+        }
+        while (at < bytes.size());
+
+        for (unsigned char b : bytes)
+        {
+            adlerA = (adlerA + b) % 65521;
+            adlerB = (adlerB + adlerA) % 65521;
+        }
+
+        if (data.size() > (1 << 16)) flush();
+    }
+
+    void flush()
+    {
+        if (data.empty()) return;
+        chunk("IDAT", data);
+        data.clear();
+    }
+};
+
+// Writes an image in the format named by the path's extension
+inline bool saveImage(const std::string& path, int width, int height, const std::vector<float>& linear)
+{
+    if (path == "-")
+    {
+        writePPM(std::cout, width, height, linear);
+        return bool(std::cout.flush());
+    }
+
+    std::string ext = path.substr(path.find_last_of('.') + 1);
+    for (char& c : ext) c = std::tolower(c);
+    if (ext != "ppm" && ext != "png" && ext != "pfm")
+    {
+        std::cerr << "ERROR: Unknown image format " << path << std::endl;
+        return false;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "ERROR: Cannot open " << path << std::endl;
+        return false;
+    }
+
+    if (ext == "ppm") writePPM(file, width, height, linear);
+    else if (ext == "pfm") writePFM(file, width, height, linear);
+    else PNGWriter(file).write(width, height, linear);
+
+    return bool(file.flush());
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef INSTANCE_H_
+#define INSTANCE_H_
+
+#include <cmath>
+#include <memory>
+#include "profile.hpp"
+#include "surface.hpp"
+
+// Rounding steps a point may gain going through a transform, in units of its terms
+static const Real TRANSFORM_ERROR_ULPS = 8;
+
+// An affine map, taking the axes to x, y and z and the origin to offset
+struct Transform
+{
+    Vec3 x = Vec3(1, 0, 0);
+    Vec3 y = Vec3(0, 1, 0);
+    Vec3 z = Vec3(0, 0, 1);
+    Vec3 offset = Vec3(0);
+
+    // Moves to a point, scaled evenly and turned about y by yaw degrees
+    static Transform placement(const Vec3& at, Real scale, Real yaw)
+    {
+        const Real angle = glm::radians(yaw);
+        const Real c = std::cos(angle) * scale, s = std::sin(angle) * scale;
+        Transform m;
+        m.x = Vec3(c, 0, -s);
+        m.y = Vec3(0, scale, 0);
+        m.z = Vec3(s, 0, c);
+        m.offset = at;
+        return m;
+    }
+
+    Vec3 point(const Vec3& p) const { return p.x * x + p.y * y + p.z * z + offset; }
+    Vec3 vector(const Vec3& v) const { return v.x * x + v.y * y + v.z * z; }
+
+    // Applies the transpose, which for an inverse carries normals
+    Vec3 transposed(const Vec3& v) const { return Vec3(glm::dot(x, v), glm::dot(y, v), glm::dot(z, v)); }
+
+    // Largest sizes of the terms summed for a point, which bound its rounding
+    Vec3 magnitude(const Vec3& p) const
+    {
+        return glm::abs(p.x * x) + glm::abs(p.y * y) + glm::abs(p.z * z) + glm::abs(offset);
+    }
+
+    Real determinant() const { return glm::dot(x, glm::cross(y, z)); }
+
+    // Rows of the inverse are the cross products of pairs of columns
+    Transform inverse() const
+    {
+        const Real inv = 1 / determinant();
+        const Vec3 r0 = glm::cross(y, z) * inv, r1 = glm::cross(z, x) * inv, r2 = glm::cross(x, y) * inv;
+        Transform m;
+        m.x = Vec3(r0.x, r1.x, r2.x);
+        m.y = Vec3(r0.y, r1.y, r2.y);
+        m.z = Vec3(r0.z, r1.z, r2.z);
+        m.offset = -m.vector(offset);
+        return m;
+    }
+
+    AABB apply(const AABB& box) const
+    {
+        AABB moved;
+        for (int i = 0; i < 8; ++i)
+        {
+            moved.grow(point(Vec3(i & 1 ? box.hi.x : box.lo.x, i & 2 ? box.hi.y : box.lo.y, i & 4 ? box.hi.z : box.lo.z)));
+        }
+        return moved;
+    }
+};
+
+// Places a shared surface, such as a mesh or a BVH, through an affine transform
+// Rays are taken into the surface's own space, so any number of instances share its memory
+class Instance: public Surface
+{ public:
+
+    Instance(std::shared_ptr<const Surface> object, const Transform& toWorld) : object(object)
+    {
+        place(toWorld);
+    }
+
+    // Moving an instance leaves its hierarchy stale until refitted or rebuilt
+    void place(const Transform& toWorld)
+    {
+        this->toWorld = toWorld;
+        toObject = toWorld.inverse();
+
+        // Bounds how far the transform can stretch an error
+        stretch = std::sqrt(glm::dot(toWorld.x, toWorld.x) + glm::dot(toWorld.y, toWorld.y) + glm::dot(toWorld.z, toWorld.z));
+    }
+
+    const Transform& transform() const { return toWorld; }
+
+    bool hit(const Ray& ray, Real tMin, Real tMax, RayHit& hit) const
+    {
+        // Directions are left unnormalised, so t means the same in both spaces
+        PROFILE_COUNT(INSTANCE_TESTS);
+        const Ray local(toObject.point(ray.org), toObject.vector(ray.dir));
+        if (!object->hit(local, tMin, tMax, hit)) return false;
+
+        const Vec3 size = toWorld.magnitude(hit.point);
+        hit.point = toWorld.point(hit.point);
+        hit.error = hit.error * stretch + TRANSFORM_ERROR_ULPS * EPSILON * glm::max(size.x, glm::max(size.y, size.z));
+
+        // Normals go through the inverse transpose, which keeps them on the same side of the ray
+        hit.norm = glm::normalize(toObject.transposed(hit.norm));
+        return true;
+    }
+
+    bool occluded(const Ray& ray, Real tMin, Real tMax) const
+    {
+        PROFILE_COUNT(INSTANCE_TESTS);
+        return object->occluded(Ray(toObject.point(ray.org), toObject.vector(ray.dir)), tMin, tMax);
+    }
+
+    bool bounds(AABB& box) const
+    {
+        AABB local;
+        if (!object->bounds(local)) return false;
+        box = toWorld.apply(local);
+
+        // Widened by the rounding of the corners, which hits may reach
+        const Vec3 size = glm::max(glm::abs(box.lo), glm::abs(box.hi));
+        const Vec3 pad = Vec3(TRANSFORM_ERROR_ULPS * EPSILON * glm::max(size.x, glm::max(size.y, size.z)));
+        box = AABB(box.lo - pad, box.hi + pad);
+        return true;
+    }
+
+private:
+
+    std::shared_ptr<const Surface> object;
+    Transform toWorld;
+    Transform toObject;
+    Real stretch;
+};
+
+#endif
@@ -0,0 +1,349 @@
+#ifndef INTEGRATOR_H_
+#define INTEGRATOR_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "material.hpp"
+#include "packet.hpp"
+#include "profile.hpp"
+#include "scene.hpp"
+#include "surface.hpp"
+#include "utility.hpp"
+
+// Largest number of paths a wavefront keeps in flight
+static const size_t WAVE_PATHS = 4096;
+
+// Light arriving from the background
+inline Vec3 sky(const Ray& ray)
+{
+    Real y = glm::normalize(ray.dir).y * Real(0.5) + Real(0.5);
+    return glm::mix(Vec3(1), Vec3(0.5, 0.7, 1.0), y);
+}
+
+// What a camera path's first hit shows, which guides the denoiser
+struct Features
+{
+    Vec3 albedo = Vec3(0);
+    Vec3 normal = Vec3(0);
+    Vec3 position = Vec3(0);
+    Real depth = 0;
+};
+
+// The sky has no surface, so only its colour is kept
+inline Features skyFeatures(const Ray& ray)
+{
+    Features f;
+    f.albedo = sky(ray);
+    return f;
+}
+
+inline Features hitFeatures(const Ray& ray, const RayHit& hit, const Scene& scene)
+{
+    Features f;
+    f.albedo = scene.materials[hit.mat].albedo;
+    f.normal = hit.norm;
+    f.position = hit.point;
+    f.depth = hit.t * glm::length(ray.dir);
+    return f;
+}
+
+// When paths stop
+struct PathLimits
+{
+    // Hard limit on bounces
+    int maxDepth;
+
+    // Bounces before Russian roulette begins, and the lowest chance of surviving it
+    int rouletteDepth;
+    Real rouletteFloor;
+};
+
+// Rays traced per path, to weigh time saved against noise added
+struct PathStats
+{
+    uint64_t paths = 0;
+    uint64_t rays = 0;
+
+    void add(const PathStats& other)
+    {
+        paths += other.paths;
+        rays += other.rays;
+    }
+
+    double averageLength() const { return paths ? double(rays) / paths : 0.0; }
+};
+
+// Russian roulette, after the given number of bounces
+// Dim paths are likely to end, and survivors are brightened to keep the mean unbiased
+inline bool survive(Vec3& throughput, int bounces, const PathLimits& limits)
+{
+    if (bounces < limits.rouletteDepth) return true;
+    Real p = glm::max(throughput.x, glm::max(throughput.y, throughput.z));
+    p = glm::clamp(p, limits.rouletteFloor, Real(1));
+    if (randomDouble() >= p) return false;
+    throughput /= p;
+    return true;
+}
+
+// Weight of one of two ways of sampling the same direction, given both densities,
+// by the power heuristic (Veach)
+inline Real powerHeuristic(Real pdf, Real other)
+{
+    const Real ratio = other / pdf;
+    return 1 / (1 + ratio * ratio);
+}
+
+// Light reaching a diffuse hit straight from a light picked for it, checked by a shadow ray
+// and weighed against the chance of the bounce from the hit finding the same light
+inline Vec3 directLight(const RayHit& hit, const MaterialData& m, const Scene& scene, int depth, PathStats& stats)
+{
+    sampleStream().light(depth);
+    const double u0 = randomDouble(), u1 = randomDouble(), u2 = randomDouble();
+    LightSample s;
+    if (!scene.lights.sample(hit.point, u0, u1, u2, s)) return Vec3(0);
+    const Real cosine = glm::dot(s.dir, hit.norm);
+    if (cosine <= 0) return Vec3(0);
+
+    ++stats.rays;
+    PROFILE_COUNT(SHADOW_RAYS);
+
+    // The light is met again from where the shadow ray leaves, just off the surface, as near
+    // the light's edge even that small step moves where the ray meets it
+    const Ray shadow = hit.spawn(s.dir);
+    Real t0, t1;
+    if (!sphereRoots(shadow.org, shadow.dir, s.light->mid, s.light->rad, t0, t1) || t1 <= 0) return Vec3(0);
+    if (scene.occluded(shadow, 0, (t0 > 0 ? t0 : t1) * (1 - LIGHT_SHADOW_GAP))) return Vec3(0);
+
+    const Real weight = powerHeuristic(s.pdf, diffusePdf(hit, s.dir));
+    return m.albedo * s.radiance * (cosine / glm::pi<Real>() * weight / s.pdf);
+}
+
+// Share of an emitter's light a path keeps on reaching it, having left from a point with a
+// bounce of the given density, which is 0 where no light was sampled
+inline Real emitterWeight(const Scene& scene, const Vec3& from, Real bouncePdf, const RayHit& hit)
+{
+    if (bouncePdf <= 0) return 1;
+    return powerHeuristic(bouncePdf, scene.lights.pdf(from, hit.point, hit.mat));
+}
+
+// Density of the bounce scattered from a hit, for weighing what it finds against light
+// sampling, or 0 where lights are not sampled
+inline Real bouncePdf(const Scene& scene, const MaterialData& m, const RayHit& hit, const Ray& scattered)
+{
+    if (m.type != DIFFUSE || scene.lights.empty()) return 0;
+    return diffusePdf(hit, glm::normalize(scattered.dir));
+}
+
+// Follows one path, carrying its throughput forward bounce by bounce
+// Diffuse hits also sample the scene's lights, and what bounces find on them is weighed to match
+// A known first hit, such as one found by a packet, skips the first search
+// What the first hit shows goes to features, if given
+// TODO multiple bounces on hit and lower AA_X for more efficient rendering
+inline Vec3 trace(Ray ray, const Scene& scene, const PathLimits& limits, PathStats& stats,
+                  const RayHit* first = nullptr, Features* features = nullptr)
+{
+    Vec3 throughput(1), radiance(0);
+    RayHit hit{};
+    ++stats.paths;
+    int length = 0;
+
+    // Where the last bounce left from, and its density
+    Vec3 from(0);
+    Real lastPdf = 0;
+
+    for (int depth = 0; depth < limits.maxDepth; ++depth)
+    {
+        ++stats.rays;
+        ++length;
+        PROFILE_COUNT(RAYS_TRACED);
+        if (depth == 0 && first) hit = *first;
+        else if (!scene.hit(ray, 0, INF, hit))
+        {
+            if (depth == 0 && features) *features = skyFeatures(ray);
+            PROFILE_PATH(length);
+            return radiance + throughput * sky(ray);
+        }
+        if (depth == 0 && features) *features = hitFeatures(ray, hit, scene);
+
+        const MaterialData& m = scene.materials[hit.mat];
+        if (m.type == EMISSIVE)
+        {
+            radiance += throughput * m.albedo * emitterWeight(scene, from, lastPdf, hit);
+            break;
+        }
+        if (m.type == DIFFUSE && !scene.lights.empty()) radiance += throughput * directLight(hit, m, scene, depth, stats);
+
+        sampleStream().bounce(depth);
+        Ray scattered(ray);
+        Vec3 atten;
+        if (!scene.scatter(ray, hit, atten, scattered)) break;
+        lastPdf = bouncePdf(scene, m, hit, scattered);
+        from = hit.point;
+        throughput *= atten;
+        if (!survive(throughput, depth + 1, limits)) break;
+        ray = scattered;
+    }
+
+    PROFILE_PATH(length);
+    return radiance;
+}
+
+// A path waiting for its next bounce, and the pixel it lights
+struct PathState
+{
+    Ray ray;
+    Vec3 throughput;
+    Vec3 radiance;
+    uint32_t pixel;
+
+    // Where the last bounce left from, and its density
+    Vec3 from;
+    Real lastPdf;
+
+    // Swapped in while the path scatters, so it draws the same numbers in any order
+    SampleStream stream;
+};
+
+// Advances a batch of paths in lockstep stages rather than one at a time
+// Each worker keeps its own, so the scratch buffers are reused
+class Wavefront
+{ public:
+
+    // Traces every path to the end, handing each finished one to finish(pixel, radiance)
+    // and what each first hit shows to note(pixel, features)
+    template <typename Finish, typename Note>
+    void run(std::vector<PathState>& paths, const Scene& scene, const PathLimits& limits, bool packets,
+             PathStats& stats, Finish finish, Note note)
+    {
+        stats.paths += paths.size();
+        for (int depth = 0; depth < limits.maxDepth && !paths.empty(); ++depth)
+        {
+            stats.rays += paths.size();
+            PROFILE_ADD(RAYS_TRACED, paths.size());
+            intersect(paths, scene, packets && depth == 0);
+            if (depth == 0)
+            {
+                for (size_t i = 0; i < paths.size(); ++i)
+                {
+                    const PathState& path = paths[i];
+                    note(path.pixel, found[i] ? hitFeatures(path.ray, hits[i], scene) : skyFeatures(path.ray));
+                }
+            }
+            shade(paths, scene, depth + 1, limits, stats, finish);
+            compact(paths);
+        }
+
+        // Paths still going at the depth limit
+        for (const PathState& path : paths)
+        {
+            PROFILE_PATH(limits.maxDepth);
+            finish(path.pixel, path.radiance);
+        }
+        paths.clear();
+    }
+
+private:
+
+    std::vector<RayHit> hits;
+    std::vector<uint8_t> found;
+    std::vector<uint8_t> alive;
+    std::vector<uint32_t> queue;
+
+    // Finds the next hit of every live path
+    void intersect(const std::vector<PathState>& paths, const Scene& scene, bool packets)
+    {
+        hits.resize(paths.size());
+        found.assign(paths.size(), 0);
+
+        if (!packets)
+        {
+            for (size_t i = 0; i < paths.size(); ++i)
+            {
+                found[i] = scene.hit(paths[i].ray, 0, INF, hits[i]);
+            }
+            return;
+        }
+
+        // Fresh camera paths arrive in pixel order, so runs of them are coherent
+        for (size_t i = 0; i < paths.size(); i += PACKET_SIZE)
+        {
+            const int n = glm::min(size_t(PACKET_SIZE), paths.size() - i);
+            RayPacket packet;
+            packet.clear(0);
+            for (int k = 0; k < n; ++k) packet.set(k, paths[i + k].ray, INF);
+
+            uint32_t mask = scene.hitPacket(packet, &hits[i]);
+            for (int k = 0; k < n; ++k) found[i + k] = mask >> k & 1;
+        }
+    }
+
+    // Scatters every hit, grouped by material so each scatter runs in a tight loop
+    template <typename Finish>
+    void shade(std::vector<PathState>& paths, const Scene& scene, int bounces, const PathLimits& limits,
+               PathStats& stats, Finish& finish)
+    {
+        alive.assign(paths.size(), 0);
+        queue.clear();
+
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            PathState& path = paths[i];
+            if (found[i]) queue.push_back(i);
+            else
+            {
+                PROFILE_PATH(bounces);
+                finish(path.pixel, path.radiance + path.throughput * sky(path.ray));
+            }
+        }
+
+        std::sort(queue.begin(), queue.end(), [&](uint32_t a, uint32_t b)
+        {
+            return hits[a].mat < hits[b].mat;
+        });
+
+        for (uint32_t i : queue)
+        {
+            PathState& path = paths[i];
+            const RayHit& hit = hits[i];
+            const MaterialData& m = scene.materials[hit.mat];
+            SampleStream& stream = sampleStream();
+            stream = path.stream;
+            if (m.type == EMISSIVE) path.radiance += path.throughput * m.albedo * emitterWeight(scene, path.from, path.lastPdf, hit);
+            else if (m.type == DIFFUSE && !scene.lights.empty())
+            {
+                path.radiance += path.throughput * directLight(hit, m, scene, bounces - 1, stats);
+            }
+
+            stream.bounce(bounces - 1);
+            Ray scattered(path.ray);
+            Vec3 atten;
+            if (scene.scatter(path.ray, hit, atten, scattered))
+            {
+                path.lastPdf = bouncePdf(scene, m, hit, scattered);
+                path.from = hit.point;
+                path.ray = scattered;
+                path.throughput *= atten;
+                alive[i] = survive(path.throughput, bounces, limits);
+            }
+            path.stream = stream;
+            if (alive[i]) continue;
+            PROFILE_PATH(bounces);
+            finish(path.pixel, path.radiance);
+        }
+    }
+
+    // Drops finished paths, keeping the rest in pixel order
+    void compact(std::vector<PathState>& paths)
+    {
+        size_t live = 0;
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            if (alive[i]) paths[live++] = paths[i];
+        }
+        paths.erase(paths.begin() + live, paths.end());
+    }
+};
+
+#endif
@@ -0,0 +1,358 @@
+#ifndef KERNELS_H_
+#define KERNELS_H_
+
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#else
+#define KERNELS_X86 0
+#endif
+
+// Cache line aligned storage, so vector loads never straddle lines
+template <typename T>
+struct AlignedAllocator
+{
+    typedef T value_type;
+    static const size_t ALIGN = 64;
+
+    AlignedAllocator() { }
+    template <typename U> AlignedAllocator(const AlignedAllocator<U>&) { }
+
+    T* allocate(size_t n)
+    {
+        // Over-allocate and keep the original pointer just before the block
+        void* raw = std::malloc(n * sizeof(T) + ALIGN + sizeof(void*));
+        if (!raw) throw std::bad_alloc();
+        size_t at = (reinterpret_cast<size_t>(raw) + sizeof(void*) + ALIGN - 1) & ~(ALIGN - 1);
+        reinterpret_cast<void**>(at)[-1] = raw;
+        return reinterpret_cast<T*>(at);
+    }
+
+    void deallocate(T* p, size_t)
+    {
+        std::free(reinterpret_cast<void**>(p)[-1]);
+    }
+
+    template <typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template <typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// Spheres as separate coordinate arrays
+template <typename T>
+struct SphereArrays
+{
+    const T* x;
+    const T* y;
+    const T* z;
+    const T* rad;
+};
+
+// A ray broken into scalars, with the squared length of its direction
+template <typename T>
+struct KernelRay
+{
+    T ox, oy, oz;
+    T dx, dy, dz;
+    T a, invA;
+};
+
+// Tests spheres [start, start + count) and returns the index of the closest
+// hit inside (tMin, tMax), shortening tMax to it, or -1 if there is none
+// Every kernel finds roots as sphereRoots does, so float kernels go by the ray's closest approach
+template <typename T>
+using SphereKernel = long (*)(const SphereArrays<T>& s, size_t start, size_t count,
+                              const KernelRay<T>& r, T tMin, T& tMax);
+
+template <typename T>
+inline long hitSpheresScalar(const SphereArrays<T>& s, size_t start, size_t count,
+                             const KernelRay<T>& r, T tMin, T& tMax)
+{
+    long best = -1;
+    for (size_t i = start; i < start + count; ++i)
+    {
+        T fx = r.ox - s.x[i], fy = r.oy - s.y[i], fz = r.oz - s.z[i];
+        T b = fx * r.dx + fy * r.dy + fz * r.dz;
+        T k = b * r.invA;
+        T h;
+        if (sizeof(T) < sizeof(double))
+        {
+            T lx = fx - k * r.dx, ly = fy - k * r.dy, lz = fz - k * r.dz;
+            h = s.rad[i] * s.rad[i] - (lx * lx + ly * ly + lz * lz);
+        }
+        else h = k * b - (fx * fx + fy * fy + fz * fz - s.rad[i] * s.rad[i]);
+        if (h <= 0) continue;
+
+        T root = std::sqrt(h * r.invA);
+        T t = -k - root;
+        if (!(t > tMin && t < tMax)) t = -k + root;
+        if (t > tMin && t < tMax)
+        {
+            tMax = t;
+            best = i;
+        }
+    }
+    return best;
+}
+
+#if KERNELS_X86
+
+// Four double spheres per step
+__attribute__((target("avx2,fma")))
+inline long hitSpheresAVX2(const SphereArrays<double>& s, size_t start, size_t count,
+                           const KernelRay<double>& r, double tMin, double& tMax)
+{
+    const __m256d ox = _mm256_set1_pd(r.ox), oy = _mm256_set1_pd(r.oy), oz = _mm256_set1_pd(r.oz);
+    const __m256d dx = _mm256_set1_pd(r.dx), dy = _mm256_set1_pd(r.dy), dz = _mm256_set1_pd(r.dz);
+    const __m256d invA = _mm256_set1_pd(r.invA), a = _mm256_set1_pd(r.a);
+    const __m256d lo = _mm256_set1_pd(tMin);
+    const __m256d lanes = _mm256_set_pd(3.0, 2.0, 1.0, 0.0);
+    const __m256d zero = _mm256_setzero_pd();
+
+    long best = -1;
+    for (size_t i = start; i < start + count; i += 4)
+    {
+        const __m256d hi = _mm256_set1_pd(tMax);
+        const __m256d live = _mm256_cmp_pd(lanes, _mm256_set1_pd(double(start + count - i)), _CMP_LT_OQ);
+
+        __m256d px = _mm256_sub_pd(ox, _mm256_loadu_pd(s.x + i));
+        __m256d py = _mm256_sub_pd(oy, _mm256_loadu_pd(s.y + i));
+        __m256d pz = _mm256_sub_pd(oz, _mm256_loadu_pd(s.z + i));
+        __m256d rad = _mm256_loadu_pd(s.rad + i);
+
+        __m256d b = _mm256_fmadd_pd(px, dx, _mm256_fmadd_pd(py, dy, _mm256_mul_pd(pz, dz)));
+        __m256d c = _mm256_fmsub_pd(px, px, _mm256_fmsub_pd(rad, rad, _mm256_fmadd_pd(py, py, _mm256_mul_pd(pz, pz))));
+        __m256d disc = _mm256_fmsub_pd(b, b, _mm256_mul_pd(a, c));
+        __m256d valid = _mm256_and_pd(live, _mm256_cmp_pd(disc, zero, _CMP_GT_OQ));
+        if (!_mm256_movemask_pd(valid)) continue;
+
+        __m256d root = _mm256_sqrt_pd(disc);
+        __m256d nb = _mm256_sub_pd(zero, b);
+        __m256d t0 = _mm256_mul_pd(_mm256_sub_pd(nb, root), invA);
+        __m256d t1 = _mm256_mul_pd(_mm256_add_pd(nb, root), invA);
+        __m256d in0 = _mm256_and_pd(_mm256_cmp_pd(t0, lo, _CMP_GT_OQ), _mm256_cmp_pd(t0, hi, _CMP_LT_OQ));
+        __m256d in1 = _mm256_and_pd(_mm256_cmp_pd(t1, lo, _CMP_GT_OQ), _mm256_cmp_pd(t1, hi, _CMP_LT_OQ));
+        __m256d t = _mm256_blendv_pd(t1, t0, in0);
+        int mask = _mm256_movemask_pd(_mm256_and_pd(valid, _mm256_or_pd(in0, in1)));
+        if (!mask) continue;
+
+        alignas(32) double ts[4];
+        _mm256_store_pd(ts, t);
+        for (int k = 0; k < 4; ++k)
+        {
+            if ((mask >> k & 1) && ts[k] < tMax)
+            {
+                tMax = ts[k];
+                best = i + k;
+            }
+        }
+    }
+    return best;
+}
+
+// Eight float spheres per step
+__attribute__((target("avx2,fma")))
+inline long hitSpheresAVX2(const SphereArrays<float>& s, size_t start, size_t count,
+                           const KernelRay<float>& r, float tMin, float& tMax)
+{
+    const __m256 ox = _mm256_set1_ps(r.ox), oy = _mm256_set1_ps(r.oy), oz = _mm256_set1_ps(r.oz);
+    const __m256 dx = _mm256_set1_ps(r.dx), dy = _mm256_set1_ps(r.dy), dz = _mm256_set1_ps(r.dz);
+    const __m256 invA = _mm256_set1_ps(r.invA);
+    const __m256 lo = _mm256_set1_ps(tMin);
+    const __m256 lanes = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+    const __m256 zero = _mm256_setzero_ps();
+
+    long best = -1;
+    for (size_t i = start; i < start + count; i += 8)
+    {
+        const __m256 hi = _mm256_set1_ps(tMax);
+        const __m256 live = _mm256_cmp_ps(lanes, _mm256_set1_ps(float(start + count - i)), _CMP_LT_OQ);
+
+        __m256 fx = _mm256_sub_ps(ox, _mm256_loadu_ps(s.x + i));
+        __m256 fy = _mm256_sub_ps(oy, _mm256_loadu_ps(s.y + i));
+        __m256 fz = _mm256_sub_ps(oz, _mm256_loadu_ps(s.z + i));
+        __m256 rad = _mm256_loadu_ps(s.rad + i);
+
+        __m256 along = _mm256_mul_ps(_mm256_fmadd_ps(fx, dx, _mm256_fmadd_ps(fy, dy, _mm256_mul_ps(fz, dz))), invA);
+        __m256 lx = _mm256_fnmadd_ps(along, dx, fx);
+        __m256 ly = _mm256_fnmadd_ps(along, dy, fy);
+        __m256 lz = _mm256_fnmadd_ps(along, dz, fz);
+        __m256 h = _mm256_fmsub_ps(rad, rad, _mm256_fmadd_ps(lx, lx, _mm256_fmadd_ps(ly, ly, _mm256_mul_ps(lz, lz))));
+        __m256 valid = _mm256_and_ps(live, _mm256_cmp_ps(h, zero, _CMP_GT_OQ));
+        if (!_mm256_movemask_ps(valid)) continue;
+
+        __m256 root = _mm256_sqrt_ps(_mm256_mul_ps(h, invA));
+        __m256 nk = _mm256_sub_ps(zero, along);
+        __m256 t0 = _mm256_sub_ps(nk, root);
+        __m256 t1 = _mm256_add_ps(nk, root);
+        __m256 in0 = _mm256_and_ps(_mm256_cmp_ps(t0, lo, _CMP_GT_OQ), _mm256_cmp_ps(t0, hi, _CMP_LT_OQ));
+        __m256 in1 = _mm256_and_ps(_mm256_cmp_ps(t1, lo, _CMP_GT_OQ), _mm256_cmp_ps(t1, hi, _CMP_LT_OQ));
+        __m256 t = _mm256_blendv_ps(t1, t0, in0);
+        int mask = _mm256_movemask_ps(_mm256_and_ps(valid, _mm256_or_ps(in0, in1)));
+        if (!mask) continue;
+
+        alignas(32) float ts[8];
+        _mm256_store_ps(ts, t);
+        for (int k = 0; k < 8; ++k)
+        {
+            if ((mask >> k & 1) && ts[k] < tMax)
+            {
+                tMax = ts[k];
+                best = i + k;
+            }
+        }
+    }
+    return best;
+}
+
+// Eight double spheres per step
+__attribute__((target("avx512f")))
+inline long hitSpheresAVX512(const SphereArrays<double>& s, size_t start, size_t count,
+                             const KernelRay<double>& r, double tMin, double& tMax)
+{
+    const __m512d ox = _mm512_set1_pd(r.ox), oy = _mm512_set1_pd(r.oy), oz = _mm512_set1_pd(r.oz);
+    const __m512d dx = _mm512_set1_pd(r.dx), dy = _mm512_set1_pd(r.dy), dz = _mm512_set1_pd(r.dz);
+    const __m512d invA = _mm512_set1_pd(r.invA), a = _mm512_set1_pd(r.a);
+    const __m512d lo = _mm512_set1_pd(tMin);
+    const __m512d zero = _mm512_setzero_pd();
+
+    long best = -1;
+    for (size_t i = start; i < start + count; i += 8)
+    {
+        const size_t left = start + count - i;
+        const __mmask8 live = left >= 8 ? 0xFF : __mmask8((1u << left) - 1);
+        const __m512d hi = _mm512_set1_pd(tMax);
+
+        __m512d px = _mm512_sub_pd(ox, _mm512_maskz_loadu_pd(live, s.x + i));
+        __m512d py = _mm512_sub_pd(oy, _mm512_maskz_loadu_pd(live, s.y + i));
+        __m512d pz = _mm512_sub_pd(oz, _mm512_maskz_loadu_pd(live, s.z + i));
+        __m512d rad = _mm512_maskz_loadu_pd(live, s.rad + i);
+
+        __m512d b = _mm512_fmadd_pd(px, dx, _mm512_fmadd_pd(py, dy, _mm512_mul_pd(pz, dz)));
+        __m512d c = _mm512_fmsub_pd(px, px, _mm512_fmsub_pd(rad, rad, _mm512_fmadd_pd(py, py, _mm512_mul_pd(pz, pz))));
+        __m512d disc = _mm512_fmsub_pd(b, b, _mm512_mul_pd(a, c));
+        __mmask8 valid = _mm512_mask_cmp_pd_mask(live, disc, zero, _CMP_GT_OQ);
+        if (!valid) continue;
+
+        __m512d root = _mm512_maskz_sqrt_pd(valid, disc);
+        __m512d nb = _mm512_sub_pd(zero, b);
+        __m512d t0 = _mm512_mul_pd(_mm512_sub_pd(nb, root), invA);
+        __m512d t1 = _mm512_mul_pd(_mm512_add_pd(nb, root), invA);
+        __mmask8 in0 = _mm512_mask_cmp_pd_mask(_mm512_cmp_pd_mask(t0, lo, _CMP_GT_OQ), t0, hi, _CMP_LT_OQ);
+        __mmask8 in1 = _mm512_mask_cmp_pd_mask(_mm512_cmp_pd_mask(t1, lo, _CMP_GT_OQ), t1, hi, _CMP_LT_OQ);
+        __mmask8 mask = valid & (in0 | in1);
+        if (!mask) continue;
+
+        alignas(64) double ts[8];
+        _mm512_store_pd(ts, _mm512_mask_blend_pd(in0, t1, t0));
+        for (int k = 0; k < 8; ++k)
+        {
+            if ((mask >> k & 1) && ts[k] < tMax)
+            {
+                tMax = ts[k];
+                best = i + k;
+            }
+        }
+    }
+    return best;
+}
+
+// Sixteen float spheres per step
+__attribute__((target("avx512f")))
+inline long hitSpheresAVX512(const SphereArrays<float>& s, size_t start, size_t count,
+                             const KernelRay<float>& r, float tMin, float& tMax)
+{
+    const __m512 ox = _mm512_set1_ps(r.ox), oy = _mm512_set1_ps(r.oy), oz = _mm512_set1_ps(r.oz);
+    const __m512 dx = _mm512_set1_ps(r.dx), dy = _mm512_set1_ps(r.dy), dz = _mm512_set1_ps(r.dz);
+    const __m512 invA = _mm512_set1_ps(r.invA);
+    const __m512 lo = _mm512_set1_ps(tMin);
+    const __m512 zero = _mm512_setzero_ps();
+
+    long best = -1;
+    for (size_t i = start; i < start + count; i += 16)
+    {
+        const size_t left = start + count - i;
+        const __mmask16 live = left >= 16 ? 0xFFFF : __mmask16((1u << left) - 1);
+        const __m512 hi = _mm512_set1_ps(tMax);
+
+        __m512 fx = _mm512_sub_ps(ox, _mm512_maskz_loadu_ps(live, s.x + i));
+        __m512 fy = _mm512_sub_ps(oy, _mm512_maskz_loadu_ps(live, s.y + i));
+        __m512 fz = _mm512_sub_ps(oz, _mm512_maskz_loadu_ps(live, s.z + i));
+        __m512 rad = _mm512_maskz_loadu_ps(live, s.rad + i);
+
+        __m512 along = _mm512_mul_ps(_mm512_fmadd_ps(fx, dx, _mm512_fmadd_ps(fy, dy, _mm512_mul_ps(fz, dz))), invA);
+        __m512 lx = _mm512_fnmadd_ps(along, dx, fx);
+        __m512 ly = _mm512_fnmadd_ps(along, dy, fy);
+        __m512 lz = _mm512_fnmadd_ps(along, dz, fz);
+        __m512 h = _mm512_fmsub_ps(rad, rad, _mm512_fmadd_ps(lx, lx, _mm512_fmadd_ps(ly, ly, _mm512_mul_ps(lz, lz))));
+        __mmask16 valid = _mm512_mask_cmp_ps_mask(live, h, zero, _CMP_GT_OQ);
+        if (!valid) continue;
+
+        __m512 root = _mm512_maskz_sqrt_ps(valid, _mm512_mul_ps(h, invA));
+        __m512 nk = _mm512_sub_ps(zero, along);
+        __m512 t0 = _mm512_sub_ps(nk, root);
+        __m512 t1 = _mm512_add_ps(nk, root);
+        __mmask16 in0 = _mm512_mask_cmp_ps_mask(_mm512_cmp_ps_mask(t0, lo, _CMP_GT_OQ), t0, hi, _CMP_LT_OQ);
+        __mmask16 in1 = _mm512_mask_cmp_ps_mask(_mm512_cmp_ps_mask(t1, lo, _CMP_GT_OQ), t1, hi, _CMP_LT_OQ);
+        __mmask16 mask = valid & (in0 | in1);
+        if (!mask) continue;
+
+        alignas(64) float ts[16];
+        _mm512_store_ps(ts, _mm512_mask_blend_ps(in0, t1, t0));
+        for (int k = 0; k < 16; ++k)
+        {
+            if ((mask >> k & 1) && ts[k] < tMax)
+            {
+                tMax = ts[k];
+                best = i + k;
+            }
+        }
+    }
+    return best;
+}
+
+#endif
+
+// Picks the widest kernel this processor supports, once
+// Setting RTIOW_SCALAR in the environment forces the scalar kernel
+template <typename T>
+inline SphereKernel<T> sphereKernel(const char** name = nullptr, unsigned* width = nullptr)
+{
+    static const char* chosen = "scalar";
+    static unsigned lanes = 1;
+    static const SphereKernel<T> kernel = []() -> SphereKernel<T>
+    {
+#if KERNELS_X86
+        __builtin_cpu_init();
+        if (!std::getenv("RTIOW_SCALAR"))
+        {
+            if (__builtin_cpu_supports("avx512f"))
+            {
+                chosen = "avx512";
+                lanes = 64 / sizeof(T);
+                return &hitSpheresAVX512;
+            }
+            if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            {
+                chosen = "avx2";
+                lanes = 32 / sizeof(T);
+                return &hitSpheresAVX2;
+            }
+        }
+#endif
+        return &hitSpheresScalar<T>;
+    }();
+    if (name) *name = chosen;
+    if (width) *width = lanes;
+    return kernel;
+}
+
+#endif
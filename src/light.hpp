@@ -0,0 +1,135 @@
+#ifndef LIGHT_H_
+#define LIGHT_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include "sphere.hpp"
+#include "utility.hpp"
+
+// Share of the distance to a light that shadow rays stop short by, so the light itself
+// is never taken for something in the way
+static const Real LIGHT_SHADOW_GAP = 1e-4;
+
+// Emissive spheres whose surface lies within this share of the radius of a hit are taken
+// to be what was hit
+static const Real LIGHT_MATCH = 1e-3;
+
+// A sphere that gives off light
+struct SphereLight
+{
+    Vec3 mid;
+    Real rad;
+    uint32_t mat;
+    Vec3 radiance;
+};
+
+// A direction towards a light, and what arrives along it
+struct LightSample
+{
+    const SphereLight* light;
+    Vec3 dir;
+    Vec3 radiance;
+
+    // Per unit solid angle, including the chance of choosing the light
+    Real pdf;
+};
+
+// Every emitter of a scene, chosen between in proportion to their power
+// Each is sampled over the cone it fills as seen from the point lit, so no direction is wasted
+// on its far side or on missing it
+class LightList
+{ public:
+
+    void add(const Vec3& mid, Real rad, uint32_t mat, const Vec3& radiance)
+    {
+        const double power = luminance(radiance) * rad * rad;
+        if (!(power > 0)) return;
+        lights.push_back(SphereLight{ mid, glm::abs(rad), mat, radiance });
+        cdf.push_back((cdf.empty() ? 0.0 : cdf.back()) + power);
+    }
+
+    bool empty() const { return lights.empty(); }
+    size_t size() const { return lights.size(); }
+
+    // Picks a light and a direction towards it from p, with three numbers in [0, 1)
+    // Fails from inside a light, which fills every direction
+    bool sample(const Vec3& p, double u0, double u1, double u2, LightSample& s) const
+    {
+        const size_t i = std::min(size_t(std::upper_bound(cdf.begin(), cdf.end(), u0 * cdf.back()) - cdf.begin()), lights.size() - 1);
+        const SphereLight& light = lights[i];
+
+        const Vec3 towards = light.mid - p;
+        const Real d2 = glm::dot(towards, towards);
+        const Real sin2 = light.rad * light.rad / d2;
+        if (sin2 >= 1) return false;
+
+        // 1 - cos of the cone, kept accurate for small and distant lights
+        const Real cosMax = glm::sqrt(1 - sin2);
+        const Real spread = sin2 / (1 + cosMax);
+        const Real cosTheta = 1 - Real(u1) * spread;
+        const Real sinTheta = glm::sqrt(glm::max(Real(0), 1 - cosTheta * cosTheta));
+        const Real phi = Real(2 * glm::pi<double>() * u2);
+
+        Vec3 w = towards / glm::sqrt(d2), u, v;
+        basis(w, u, v);
+        s.light = &light;
+        s.dir = glm::normalize(u * (sinTheta * glm::cos(phi)) + v * (sinTheta * glm::sin(phi)) + w * cosTheta);
+        s.radiance = light.radiance;
+        s.pdf = Real(chance(i)) / (2 * glm::pi<Real>() * spread);
+        return true;
+    }
+
+    // Density sample would have had for the direction from p that reached an emitter of
+    // material mat at hitPoint, or 0 if no light is there
+    Real pdf(const Vec3& p, const Vec3& hitPoint, uint32_t mat) const
+    {
+        long found = -1;
+        Real closest = INF;
+        for (size_t i = 0; i < lights.size(); ++i)
+        {
+            const SphereLight& light = lights[i];
+            if (light.mat != mat) continue;
+            const Real off = glm::abs(glm::length(hitPoint - light.mid) - light.rad);
+            if (off < closest && off <= LIGHT_MATCH * light.rad)
+            {
+                closest = off;
+                found = i;
+            }
+        }
+        if (found < 0) return 0;
+
+        const SphereLight& light = lights[found];
+        const Vec3 towards = light.mid - p;
+        const Real sin2 = light.rad * light.rad / glm::dot(towards, towards);
+        if (sin2 >= 1) return 0;
+        const Real spread = sin2 / (1 + glm::sqrt(1 - sin2));
+        return Real(chance(found)) / (2 * glm::pi<Real>() * spread);
+    }
+
+private:
+
+    std::vector<SphereLight> lights;
+
+    // Running total of power, which lights are picked from
+    std::vector<double> cdf;
+
+    double chance(size_t i) const
+    {
+        return (cdf[i] - (i ? cdf[i - 1] : 0.0)) / cdf.back();
+    }
+
+    // Two unit vectors at right angles to w and each other (Duff et al.)
+    static void basis(const Vec3& w, Vec3& u, Vec3& v)
+    {
+        const Real sign = w.z < 0 ? Real(-1) : Real(1);
+        const Real a = -1 / (sign + w.z);
+        const Real b = w.x * w.y * a;
+        u = Vec3(1 + sign * w.x * w.x * a, sign * b, -sign * w.x);
+        v = Vec3(b, sign + w.y * w.y * a, -w.y);
+    }
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef LINES_H_
+#define LINES_H_
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "real.hpp"
+
+// Bytes read from a text file at a time
+static const size_t TEXT_BLOCK = 1 << 20;
+
+// The words of one line, read in place, and anything after # is ignored
+class TextLine
+{ public:
+
+    TextLine(const char* begin, const char* end) : at(begin), end(end) { }
+
+    bool word(std::string& text)
+    {
+        skip();
+        const char* start = at;
+        while (at < end && !space(*at)) ++at;
+        text.assign(start, at);
+        return at > start;
+    }
+
+    // The line ends in a newline, which stops strtod going further
+    bool number(Real& value)
+    {
+        skip();
+        if (at == end) return false;
+        char* stop;
+        value = Real(std::strtod(at, &stop));
+        if (stop == at || (stop < end && !space(*stop))) return false;
+        at = stop;
+        return true;
+    }
+
+    bool finished()
+    {
+        skip();
+        return at == end;
+    }
+
+private:
+
+    const char* at;
+    const char* end;
+
+    static bool space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+    void skip()
+    {
+        while (at < end && space(*at)) ++at;
+        if (at < end && *at == '#') at = end;
+    }
+};
+
+// Hands each line of a file to handle(line, problem), a block at a time, so memory stays
+// bounded however long the file is
+// Stops at the first line the handler rejects, reporting its problem
+template <typename Handle>
+bool readLines(const std::string& path, Handle handle)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "ERROR: Cannot open " << path << std::endl;
+        return false;
+    }
+
+    std::vector<char> buffer;
+    std::string problem;
+    size_t lineNumber = 0;
+
+    // Whole lines are handled from each block, and any partial line is carried over
+    size_t kept = 0;
+    while (true)
+    {
+        buffer.resize(kept + TEXT_BLOCK);
+        file.read(buffer.data() + kept, TEXT_BLOCK);
+        size_t size = kept + file.gcount();
+        const bool last = size < buffer.size();
+
+        // A final line without a newline still gets one
+        if (last && (size == 0 || buffer[size - 1] != '\n')) buffer[size++] = '\n';
+
+        size_t start = 0;
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (buffer[i] != '\n') continue;
+            ++lineNumber;
+            TextLine line(&buffer[start], &buffer[i + 1]);
+            if (!handle(line, problem))
+            {
+                std::cerr << "ERROR: " << path << ":" << lineNumber << ": " << problem << std::endl;
+                return false;
+            }
+            start = i + 1;
+        }
+
+        if (last) return true;
+        kept = size - start;
+        std::memmove(buffer.data(), buffer.data() + start, kept);
+    }
+}
+
+#endif
@@ -3,8 +3,12 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtx/norm.hpp>
+#include <chrono>
+#include <future>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <math.h>
 #include "config.hpp"
 #include "shader.hpp"
@@ -12,9 +16,22 @@
 #include "ray.hpp"
 #include "sphere.hpp"
 #include "geometry.hpp"
+#include "bvh.hpp"
+#include "instance.hpp"
+#include "spheres.hpp"
+#include "scene.hpp"
+#include "scenefile.hpp"
 #include "utility.hpp"
 #include "material.hpp"
 #include "camera.hpp"
+#include "pool.hpp"
+#include "options.hpp"
+#include "image.hpp"
+#include "renderer.hpp"
+#include "budget.hpp"
+#include "distributed.hpp"
+#include "bench.hpp"
+#include "profile.hpp"
 
 // Keyboard input callback
 void keyCallback(GLFWwindow* win, int key, int scancode, int action, int mods)
@@ -25,25 +42,33 @@ void keyCallback(GLFWwindow* win, int key, int scancode, int action, int mods)
     }
 }
 
-// Mouse cursor movement callback
-double xold, yold;
+// Mouse cursor movement callback, gathering movement until the camera takes it
+double xold, yold, xmoved, ymoved;
+bool looking = false;
 void cursorPosCallback(GLFWwindow* win, double xpos, double ypos)
 {
+    if (looking)
+    {
+        xmoved += xpos - xold;
+        ymoved += ypos - yold;
+    }
     xold = xpos;
     yold = ypos;
 }
 
-// Mouse button input callback
+// Mouse button input callback, holding a button to look around
 void mouseButtonCallback(GLFWwindow* win, int button, int action, int mods)
 {
-    if (action == GLFW_PRESS) { }
+    if (button != GLFW_MOUSE_BUTTON_LEFT) return;
+    looking = action == GLFW_PRESS;
+    glfwSetInputMode(win, GLFW_CURSOR, looking ? GLFW_CURSOR_DISABLED : GLFW_CURSOR_NORMAL);
 }
 
 // Mouse scroll wheel movement callback
 void scrollCallback(GLFWwindow* win, double xoffset, double yoffset) { }
 
 // Creates and returns a window
-GLFWwindow* makeWindow(const char* title)
+GLFWwindow* makeWindow(const char* title, int width, int height)
 {
     GLFWwindow* win = nullptr;
     glfwInit();
@@ -67,7 +92,7 @@ GLFWwindow* makeWindow(const char* title)
         const GLFWvidmode* mode = glfwGetVideoMode(mon);
         win = glfwCreateWindow(mode->width, mode->height, title, mon, nullptr);
     }
-    else win = glfwCreateWindow(WIN_W, WIN_H, title, nullptr, nullptr);
+    else win = glfwCreateWindow(width, height, title, nullptr, nullptr);
 
     glfwMakeContextCurrent(win);
     // glfwSetInputMode(win, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -97,68 +122,44 @@ GLFWwindow* makeWindow(const char* title)
     glewExperimental = GL_TRUE;
     glewInit();
 
-    int width, height;
     glfwGetFramebufferSize(win, &width, &height);
     glViewport(0, 0, width, height);
 
     return win;
 }
 
-// TODO begin at depth 0 and count up instead
-// TODO multiple bounces on hit and lower AA_X for more efficient rendering
-glm::dvec3 raycast(const Ray& ray, const Surface& world, int depth)
+// The random spheres scene, which is the same for a given seed
+Geometry demoScene(uint32_t seed)
 {
-    if (depth <= 0) return glm::dvec3(0.0);
-    RayHit hit;
-
-    // A non-zero minimum t value kills shadow acne
-    if (world.hit(ray, 0.0001, INF, hit))
-    {
-        Ray scattered(glm::dvec3(0.0), glm::dvec3(0.0));
-        glm::dvec3 atten;
-        if (hit.mat->scatter(ray, hit, atten, scattered))
-        {
-            return atten * raycast(scattered, world, depth - 1);
-        }
-        return glm::dvec3(0.0);
-    }
-
-    double y = glm::normalize(ray.dir).y * 0.5 + 0.5;
-    return glm::mix(glm::dvec3(1.0), glm::dvec3(0.5, 0.7, 1.0), y);
-}
-
-//
-GLubyte* draw()
-{
-    Camera cam(glm::dvec3(13.0, 2.0, 3.0), glm::dvec3(0.0, 0.0, 0.0));
     Geometry world;
+    seedRandom(seed);
 
-    auto matGround = std::make_shared<Diffuse>(glm::dvec3(0.5, 0.5, 0.5));
-    world.add(std::make_shared<Sphere>(glm::dvec3(0.0, -1000.0, 0.0), 1000.0, matGround));
+    auto matGround = std::make_shared<Diffuse>(Vec3(0.5, 0.5, 0.5));
+    world.add(std::make_shared<Sphere>(Vec3(0.0, -1000.0, 0.0), 1000.0, matGround));
 
     for (int a = -11; a < 11; a++)
     {
         for (int b = -11; b < 11; b++)
         {
-            double r = random();
-            glm::dvec3 center(a + 0.9 * random(), 0.2, b + 0.9 * random());
+            double r = randomDouble();
+            Vec3 center(a + 0.9 * randomDouble(), 0.2, b + 0.9 * randomDouble());
 
-            if ((center - glm::dvec3(4, 0.2, 0)).length() > 0.9)
+            if ((center - Vec3(4, 0.2, 0)).length() > 0.9)
             {
                 std::shared_ptr<Material> sphere_material;
 
                 if (r < 0.8)
                 {
                     // diffuse
-                    glm::dvec3 albedo = randomColor() * randomColor();
+                    Vec3 albedo = randomColor() * randomColor();
                     sphere_material = std::make_shared<Diffuse>(albedo);
                     world.add(std::make_shared<Sphere>(center, 0.2, sphere_material));
                 }
                 else if (r < 0.95)
                 {
                     // metal
-                    glm::dvec3 albedo = randomColor();
-                    double fuzz = random() * 0.5;
+                    Vec3 albedo = randomColor();
+                    Real fuzz = randomDouble() * 0.5;
                     sphere_material = std::make_shared<Metal>(albedo, fuzz);
                     world.add(std::make_shared<Sphere>(center, 0.2, sphere_material));
                 }
@@ -173,67 +174,490 @@ GLubyte* draw()
     }
 
     auto mat1 = std::make_shared<Dielectric>(1.5);
-    world.add(std::make_shared<Sphere>(glm::dvec3(0, 1, 0), 1.0, mat1));
+    world.add(std::make_shared<Sphere>(Vec3(0, 1, 0), 1.0, mat1));
 
-    auto mat2 = std::make_shared<Diffuse>(glm::dvec3(0.4, 0.2, 0.1));
-    world.add(std::make_shared<Sphere>(glm::dvec3(-4, 1, 0), 1.0, mat2));
+    auto mat2 = std::make_shared<Diffuse>(Vec3(0.4, 0.2, 0.1));
+    world.add(std::make_shared<Sphere>(Vec3(-4, 1, 0), 1.0, mat2));
 
-    auto mat3 = std::make_shared<Metal>(glm::dvec3(0.7, 0.6, 0.5), 0.0);
-    world.add(std::make_shared<Sphere>(glm::dvec3(4, 1, 0), 1.0, mat3));
+    auto mat3 = std::make_shared<Metal>(Vec3(0.7, 0.6, 0.5), 0.0);
+    world.add(std::make_shared<Sphere>(Vec3(4, 1, 0), 1.0, mat3));
 
-    const int samples = glm::max(1, AA_X);
-    const int root = sqrt(samples);
-    GLubyte* pixels = new GLubyte[WIN_W * WIN_H * 3];
+    return world;
+}
 
-    for (size_t row = 0; row < WIN_H; ++row)
+// A cube of random spheres, dense enough that the hierarchy does most of the work
+std::unique_ptr<Scene> fieldScene(size_t count, uint32_t seed)
+{
+    seedRandom(seed);
+    const double side = glm::pow(double(count), 1.0 / 3.0) * 2.0;
+    Geometry world;
+    std::shared_ptr<Material> mats[] = {
+        std::make_shared<Diffuse>(Vec3(0.7, 0.3, 0.3)),
+        std::make_shared<Diffuse>(Vec3(0.3, 0.6, 0.3)),
+        std::make_shared<Metal>(Vec3(0.8), 0.1)
+    };
+    for (size_t i = 0; i < count; ++i)
     {
-        for (size_t column = 0; column < WIN_W; ++column)
+        Vec3 mid = Vec3(randomDouble(), randomDouble(), randomDouble()) * Real(side);
+        world.add(std::make_shared<Sphere>(mid, 0.5, mats[i % 3]));
+    }
+
+    View view;
+    view.from = Vec3(side * 1.6, side * 1.2, side * 1.4);
+    view.at = Vec3(side * 0.5);
+    view.vfov = 40;
+    return std::unique_ptr<Scene>(new Scene(world, view));
+}
+
+// Rows of glass spheres over a diffuse floor, so most paths refract many times
+std::unique_ptr<Scene> glassScene()
+{
+    Geometry world;
+    world.add(std::make_shared<Sphere>(Vec3(0.0, -1000.0, 0.0), 1000.0, std::make_shared<Diffuse>(Vec3(0.5))));
+    std::shared_ptr<Material> glass = std::make_shared<Dielectric>(1.5);
+    std::shared_ptr<Material> tinted = std::make_shared<Metal>(Vec3(0.9, 0.8, 0.6), 0.05);
+    for (int a = -6; a <= 6; ++a)
+    {
+        for (int b = -6; b <= 6; ++b)
         {
-#if 0
-            glm::dvec3 color(row / double(WIN_H), column / double(WIN_W), 0.5);
-#else
-            glm::dvec3 color(0.0);
+            world.add(std::make_shared<Sphere>(Vec3(a, 0.4, b), 0.4, (a + b) % 5 ? glass : tinted));
+        }
+    }
+    world.add(std::make_shared<Sphere>(Vec3(0, 2, 0), 1.5, glass));
+
+    View view;
+    view.from = Vec3(0, 6, 14);
+    view.at = Vec3(0, 0.5, 0);
+    view.vfov = 35;
+    return std::unique_ptr<Scene>(new Scene(world, view));
+}
+
+// The scene's camera, fitted to the image shape
+Camera sceneCamera(const Scene& scene, const Options& opts)
+{
+    const double aspect = opts.width / double(opts.height);
+    return Camera(scene.view.from, scene.view.at, aspect, scene.view.vfov);
+}
+
+// Milliseconds since an earlier time point
+double millis(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+// Loads the scene file, or builds the demo scene, reporting the startup cost apart from the frames
+std::unique_ptr<Scene> buildScene(const Options& opts)
+{
+    PROFILE_SCOPE("scene build");
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<Scene> scene;
+    bool cached = false;
+    if (opts.scene.empty()) scene.reset(new Scene(demoScene(opts.seed)));
+    else scene = loadScene(opts.scene, cached);
+    if (!scene) return nullptr;
+
+    std::cerr << (cached ? "Scene mapped from cache in " : "Scene built in ") << millis(start) << " ms, "
+              << (scene->spheres ? scene->spheres->size() : 0) << " spheres, "
+              << scene->materials.size() << " materials" << std::endl;
+    return scene;
+}
+
+// Times building and tracing through a BVH over growing random sphere fields
+// Packed spheres are timed against the pointer based hierarchy, then instanced under a top level
+int bvhReport()
+{
+    const size_t rays = 100000;
+    auto mat = std::make_shared<Diffuse>(Vec3(0.5));
+    MaterialTable materials;
+    const uint32_t matIndex = materials.add(mat);
+    const char* kernel;
+    sphereKernel<Real>(&kernel);
+
+    std::cout << "spheres\tbuild ms\tnodes\tns/ray\tpacked build ms\tpacked ns/ray (" << kernel << ")\thits" << std::endl;
+    for (size_t n : {10000, 100000, 1000000})
+    {
+        // Constant density, so the expected work per ray stays comparable
+        seedRandom(SEED);
+        const double side = glm::pow(double(n), 1.0 / 3.0) * 2.0;
+        Geometry world;
+        for (size_t i = 0; i < n; ++i)
+        {
+            Vec3 mid = Vec3(randomDouble(), randomDouble(), randomDouble()) * Real(side);
+            world.add(std::make_shared<Sphere>(mid, 0.5, mat));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        BVH bvh(world);
+        double build = millis(start);
 
-            for (int s = 0; s < samples; ++s)
+        start = std::chrono::steady_clock::now();
+        SphereSet spheres;
+        for (const auto& object : world.objects)
+        {
+            const Sphere& sphere = static_cast<const Sphere&>(*object);
+            spheres.add(sphere.mid, sphere.rad, matIndex);
+        }
+        spheres.build();
+        double packedBuild = millis(start);
+
+        // Rays from random interior points in random directions
+        std::vector<Ray> tests;
+        tests.reserve(rays);
+        for (size_t i = 0; i < rays; ++i)
+        {
+            Vec3 org = Vec3(randomDouble(), randomDouble(), randomDouble()) * Real(side);
+            tests.push_back(Ray(org, randomUnit()));
+        }
+
+        size_t hits = 0, packedHits = 0;
+        RayHit hit;
+        start = std::chrono::steady_clock::now();
+        for (const Ray& ray : tests) hits += bvh.hit(ray, 0, INF, hit);
+        double trace = millis(start);
+
+        start = std::chrono::steady_clock::now();
+        for (const Ray& ray : tests) packedHits += spheres.hit(ray, 0, INF, hit);
+        double packedTrace = millis(start);
+
+        std::cout << n << "\t" << build << "\t" << bvh.tree.size() << "\t"
+                  << 1e6 * trace / rays << "\t" << packedBuild << "\t"
+                  << 1e6 * packedTrace / rays << "\t" << hits;
+        if (packedHits != hits) std::cout << " (packed " << packedHits << ")";
+        std::cout << std::endl;
+    }
+
+    // One packed cluster placed many times under a top level BVH, which is then moved and refitted
+    const size_t clusterSize = 1000;
+    seedRandom(SEED);
+    auto cluster = std::make_shared<SphereSet>();
+    for (size_t i = 0; i < clusterSize; ++i)
+    {
+        cluster->add(Vec3(randomDouble(), randomDouble(), randomDouble()) * Real(20), 0.5, matIndex);
+    }
+    cluster->build();
+
+    std::cout << "\ninstances\tspheres placed\ttop build ms\trefit ms\tns/ray\thits" << std::endl;
+    for (size_t n : {1000, 10000, 100000})
+    {
+        const double side = glm::pow(double(n), 1.0 / 3.0) * 25.0;
+        Geometry world;
+        std::vector<std::shared_ptr<Instance>> instances;
+        for (size_t i = 0; i < n; ++i)
+        {
+            Vec3 at = Vec3(randomDouble(), randomDouble(), randomDouble()) * Real(side);
+            instances.push_back(std::make_shared<Instance>(cluster, Transform::placement(at, 0.5 + randomDouble(), 360 * randomDouble())));
+            world.add(instances.back());
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        BVH top(world);
+        double build = millis(start);
+
+        for (auto& instance : instances)
+        {
+            Transform moved = instance->transform();
+            moved.offset += Vec3(1, 0, 0);
+            instance->place(moved);
+        }
+        start = std::chrono::steady_clock::now();
+        top.refit();
+        double refit = millis(start);
+
+        size_t hits = 0;
+        RayHit hit;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < rays; ++i)
+        {
+            Vec3 org = Vec3(randomDouble(), randomDouble(), randomDouble()) * Real(side);
+            hits += top.hit(Ray(org, randomUnit()), 0, INF, hit);
+        }
+        double trace = millis(start);
+
+        std::cout << n << "\t" << n * clusterSize << "\t" << build << "\t" << refit << "\t"
+                  << 1e6 * trace / rays << "\t" << hits << std::endl;
+    }
+
+    return 0;
+}
+
+// Times finding the first hit of every pixel centre, alone and in packets
+int benchPrimary(const Options& opts)
+{
+    std::unique_ptr<Scene> scene = buildScene(opts);
+    if (!scene) return 1;
+    Camera cam = sceneCamera(*scene, opts);
+    const size_t rays = size_t(opts.width) * opts.height;
+    const int passes = glm::max(1, opts.samples);
+
+    size_t hits = 0;
+    RayHit hit;
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        for (int row = 0; row < opts.height; ++row)
+        {
+            for (int column = 0; column < opts.width; ++column)
             {
-                double x;
-                double y;
-                if (STRATIFY)
-                {
-                    // TODO Replace this zigzag pattern with a better one
-                    x = (0.5 + s) / samples;
-                    y = fmod(s, root) / root + (0.5 / samples);
-                }
-                else
+                Ray ray = cam.getRay((column + 0.5) / opts.width, (row + 0.5) / opts.height);
+                hits += scene->hit(ray, 0, INF, hit);
+            }
+        }
+    }
+    double single = millis(start);
+
+    size_t packetHits = 0;
+    RayHit packetHit[PACKET_SIZE];
+    start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        for (int row = 0; row < opts.height; ++row)
+        {
+            for (int column = 0; column < opts.width; column += PACKET_SIZE)
+            {
+                RayPacket packet;
+                packet.clear(0);
+                for (int i = 0; i < PACKET_SIZE && column + i < opts.width; ++i)
                 {
-                    x = random();
-                    y = random();
+                    packet.set(i, cam.getRay((column + i + 0.5) / opts.width, (row + 0.5) / opts.height), INF);
                 }
-                double u = (column + x) / double(WIN_W);
-                double v = (row + y) / double(WIN_H);
-                Ray ray = cam.getRay(u, v);
-                color += raycast(ray, world, RAY_DEPTH);
+                uint32_t found = scene->hitPacket(packet, packetHit);
+                for (; found; found &= found - 1) ++packetHits;
             }
+        }
+    }
+    double packed = millis(start);
+
+    const double total = double(rays) * passes;
+    std::cout << "Primary rays " << total << " on one thread" << std::endl
+              << "single\t" << total / single / 1000.0 << " Mrays/s\t" << hits << " hits" << std::endl
+              << "packet\t" << total / packed / 1000.0 << " Mrays/s\t" << packetHits << " hits" << std::endl
+              << "speedup\t" << single / packed << "x" << std::endl;
+    return hits == packetHits ? 0 : 1;
+}
 
-            color /= samples;
-            // Gamma correction
-            color = glm::sqrt(color);
-#endif
-            color *= 255.999;
-            for (size_t c = 0; c < 3; ++c)
+// Measures how far the second image strays from the first
+int diffImages(const Options& opts)
+{
+    int width, height, otherWidth, otherHeight;
+    std::vector<float> a, b;
+    if (!loadPFM(opts.diff[0], width, height, a) || !loadPFM(opts.diff[1], otherWidth, otherHeight, b)) return 1;
+    if (width != otherWidth || height != otherHeight)
+    {
+        std::cerr << "ERROR: Images are " << width << "x" << height << " and "
+                  << otherWidth << "x" << otherHeight << std::endl;
+        return 1;
+    }
+
+    // Visible differences are those that change a displayed byte by more than one
+    double squares = 0.0, largest = 0.0;
+    size_t at = 0, visible = 0;
+    for (size_t i = 0; i < a.size(); i += 3)
+    {
+        bool seen = false;
+        for (size_t k = i; k < i + 3; ++k)
+        {
+            const double d = double(b[k]) - a[k];
+            squares += d * d;
+            if (glm::abs(d) > largest)
             {
-                pixels[(row * WIN_W + column) * 3 + c] = color[c];
+                largest = glm::abs(d);
+                at = i / 3;
             }
+            seen = seen || glm::abs(int(toDisplay(a[k])) - int(toDisplay(b[k]))) > 1;
         }
+        visible += seen;
     }
 
-    return pixels;
+    const size_t pixels = a.size() / 3;
+    std::cout << "RMSE " << glm::sqrt(squares / a.size()) << ", largest difference " << largest
+              << " at (" << at % width << ", " << height - 1 - at / width << "), "
+              << 100.0 * visible / pixels << "% of pixels visibly different" << std::endl;
+    return 0;
+}
+
+// Renders one image without touching OpenGL
+int renderHeadless(const Options& opts)
+{
+    Pool pool(opts.threads);
+    std::cerr << "Rendering " << opts.width << "x" << opts.height << " at " << opts.samples
+              << " spp on " << pool.size() << " threads" << std::endl;
+
+    std::unique_ptr<Scene> scene = buildScene(opts);
+    if (!scene) return 1;
+    Camera cam = sceneCamera(*scene, opts);
+    Renderer renderer(opts.width, opts.height);
+    auto start = std::chrono::steady_clock::now();
+    size_t passes = 0;
+
+    // Adaptive renders continue until every pixel is quiet or time runs out
+    do
+    {
+        renderer.render(pool, cam, *scene, opts);
+        ++passes;
+    }
+    while (opts.threshold > 0.0 && renderer.activePixels()
+           && (!opts.budget || millis(start) < opts.budget));
+
+    const double elapsed = millis(start);
+    std::cerr << "Rendered in " << elapsed << " ms, " << passes << " passes, "
+              << renderer.sampleCount() << " spp on average, "
+              << renderer.pathStats().averageLength() << " rays per path, "
+              << renderer.pathStats().rays / elapsed / 1000.0 << " Mrays/s" << std::endl;
+
+    if (!opts.denoise) return saveImage(opts.output, opts.width, opts.height, renderer.image()) ? 0 : 1;
+
+    const char* kernel;
+    denoiseKernel(&kernel);
+    start = std::chrono::steady_clock::now();
+    renderer.denoise(pool, opts.denoise);
+    std::cerr << "Denoised in " << millis(start) << " ms, " << opts.denoise << " passes with the "
+              << kernel << " kernel" << std::endl;
+    return saveImage(opts.output, opts.width, opts.height, renderer.denoised()) ? 0 : 1;
+}
+
+// Hands the render out to worker processes as they join, and saves what they send back
+int serveRender(const Options& opts)
+{
+#ifdef _WIN32
+    std::cerr << "ERROR: Distributed rendering needs POSIX sockets" << std::endl;
+    return 1;
+#else
+    Renderer renderer(opts.width, opts.height);
+    Coordinator coordinator(renderer, opts);
+    if (!coordinator.listen()) return 1;
+    std::cerr << "Rendering " << opts.width << "x" << opts.height << " at " << opts.samples
+              << " spp in " << coordinator.jobCount() << " jobs" << std::endl;
+
+    // Built here first so a bad scene fails before any worker is sent it, and so workers,
+    // held until now, find its cache made rather than each parsing it at once
+    if (!buildScene(opts)) return 1;
+
+    auto start = std::chrono::steady_clock::now();
+    if (!coordinator.run()) return 1;
+    const double elapsed = millis(start);
+    std::cerr << "Rendered in " << elapsed << " ms by " << coordinator.workersSeen() << " workers, "
+              << renderer.sampleCount() << " spp on average, "
+              << renderer.pathStats().averageLength() << " rays per path, "
+              << renderer.pathStats().rays / elapsed / 1000.0 << " Mrays/s" << std::endl;
+
+    if (!opts.denoise) return saveImage(opts.output, opts.width, opts.height, renderer.image()) ? 0 : 1;
+
+    Pool pool(opts.threads);
+    start = std::chrono::steady_clock::now();
+    renderer.denoise(pool, opts.denoise);
+    std::cerr << "Denoised in " << millis(start) << " ms, " << opts.denoise << " passes" << std::endl;
+    return saveImage(opts.output, opts.width, opts.height, renderer.denoised()) ? 0 : 1;
+#endif
+}
+
+// Renders jobs for a coordinator until it has no more, with the settings it sends
+int joinRender(const Options& given)
+{
+#ifdef _WIN32
+    std::cerr << "ERROR: Distributed rendering needs POSIX sockets" << std::endl;
+    return 1;
+#else
+    Options opts = given;
+    Worker worker;
+    if (!worker.join(opts)) return 1;
+
+    Pool pool(opts.threads);
+    std::cerr << "Joined " << opts.join << " with " << pool.size() << " threads" << std::endl;
+    std::unique_ptr<Scene> scene = buildScene(opts);
+    if (!scene) return 1;
+    Camera cam = sceneCamera(*scene, opts);
+    Renderer renderer(opts.width, opts.height);
+    return worker.run(pool, renderer, cam, *scene, opts) ? 0 : 1;
+#endif
+}
+
+// Renders the fixed benchmark scenes headless and prints their timings as JSON
+// Fails if a baseline was given and any scene has slowed beyond BENCH_TOLERANCE
+int runBench(const Options& given)
+{
+    Options opts = given;
+    opts.headless = true;
+    opts.width = BENCH_WIDTH;
+    opts.height = BENCH_HEIGHT;
+    opts.samples = BENCH_SPP;
+    opts.depth = BENCH_DEPTH;
+    opts.seed = BENCH_SEED;
+    opts.threshold = 0.0;
+
+    std::map<std::string, double> baseline;
+    if (!opts.baseline.empty() && !readBaseline(opts.baseline, baseline)) return 1;
+
+    Pool pool(opts.threads);
+    std::vector<BenchResult> results;
+    const char* names[] = { "demo", "field", "glass" };
+    for (const char* name : names)
+    {
+        std::cerr << "Benchmarking " << name << std::endl;
+        BenchResult r;
+        r.name = name;
+
+        auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<Scene> scene;
+        if (r.name == "demo") scene.reset(new Scene(demoScene(opts.seed)));
+        else if (r.name == "field") scene = fieldScene(1000000, opts.seed);
+        else scene = glassScene();
+        r.build = millis(start);
+        r.objects = scene->spheres ? scene->spheres->size() : scene->world.objects.size();
+
+        Camera cam = sceneCamera(*scene, opts);
+        Renderer renderer(opts.width, opts.height);
+        start = std::chrono::steady_clock::now();
+        renderer.render(pool, cam, *scene, opts);
+        r.render = millis(start);
+
+        // What the window would do next with each frame, short of uploading it
+        std::vector<uint8_t> pixels;
+        start = std::chrono::steady_clock::now();
+        toDisplay(renderer.image(), pixels);
+        r.display = millis(start);
+
+        const PathStats stats = renderer.pathStats();
+        r.rays = stats.rays;
+        r.raysPerPath = stats.averageLength();
+        results.push_back(r);
+    }
+
+    writeBench(std::cout, results, opts, pool.size());
+    return baseline.empty() || compareBench(results, baseline) ? 0 : 1;
+}
+
+// Prints what instrumented builds counted and timed, and writes the trace if asked
+// Passes on the status of the run, unless the trace cannot be written
+int reportProfile(const Options& opts, int status)
+{
+    if (!INSTRUMENT) return status;
+    Profiler::instance().summary(std::cerr);
+    if (!opts.trace.empty() && !Profiler::instance().writeTrace(opts.trace)) return 1;
+    return status;
 }
 
 // Launches the program
-int main()
+int main(int argc, char* argv[])
 {
-    GLFWwindow* win = makeWindow("Ray Tracing In One Weekend");
+    Options opts;
+    if (!opts.parse(argc, argv)) return 1;
+    if (opts.bvhReport) return reportProfile(opts, bvhReport());
+    if (opts.benchPrimary) return reportProfile(opts, benchPrimary(opts));
+    if (opts.bench) return reportProfile(opts, runBench(opts));
+    if (!opts.diff[0].empty()) return diffImages(opts);
+    if (!opts.saveScene.empty())
+    {
+        std::unique_ptr<Scene> scene = buildScene(opts);
+        return scene && saveSceneText(opts.saveScene, *scene) ? 0 : 1;
+    }
+    if (!opts.serve.empty()) return reportProfile(opts, serveRender(opts));
+    if (!opts.join.empty()) return reportProfile(opts, joinRender(opts));
+    if (opts.headless) return reportProfile(opts, renderHeadless(opts));
+
+    std::unique_ptr<Scene> scene = buildScene(opts);
+    if (!scene) return 1;
+
+    GLFWwindow* win = makeWindow("Ray Tracing In One Weekend", opts.width, opts.height);
     if (!win)
     {
         glfwTerminate();
@@ -241,13 +665,72 @@ int main()
     }
 
     Shader shader("textured");
-    Texture texture;
+    Texture texture(opts.width, opts.height);
+    Pool pool(opts.threads);
+    Camera cam = sceneCamera(*scene, opts);
+
+    // A renderer for each scale frames are traced at, made when first needed, so each keeps
+    // what it has accumulated
+    FrameBudget budget(opts.width, opts.height, opts.samples, opts.frameTime / 1000.0);
+    std::vector<std::unique_ptr<Renderer>> renderers(FRAME_SCALE_MAX);
+    auto rendererAt = [&](int scale) -> Renderer&
+    {
+        if (!renderers[scale - 1]) renderers[scale - 1].reset(new Renderer(budget.width(scale), budget.height(scale)));
+        return *renderers[scale - 1];
+    };
+
+    // Tiles the frame in flight has finished, waiting to be uploaded
+    std::mutex finishedLock;
+    std::vector<TextureRect> finished, uploading;
+    auto tileDone = [&](const Renderer::Tile& t)
+    {
+        std::lock_guard<std::mutex> guard(finishedLock);
+        finished.push_back(TextureRect{ GLint(t.x0), GLint(t.y0), GLsizei(t.x1 - t.x0), GLsizei(t.y1 - t.y0) });
+    };
+
+    // Frames render on a thread of their own, so the window goes on drawing and uploading
+    // finished tiles while the next one traces
+    // The renderer is only read between frames, apart from the pixels of finished tiles
+    // Denoised frames are filtered whole, so they are shown once finished rather than by tiles
+    // Each frame keeps the camera it started with, which goes on moving meanwhile,
+    // and the scale and samples the budget planned for it
+    int scale = 1, shownScale = 1;
+    Camera frameCam;
+    uint64_t raysBefore = 0;
+    auto startFrame = [&]
+    {
+        const int previous = scale;
+        scale = budget.scale();
+        frameCam = cam;
+        Renderer* renderer = &rendererAt(scale);
+
+        // A change of resolution starts afresh, as a camera move does, since converged pixels
+        // would leave their tiles unrendered and so never uploaded over the other scale's frame
+        if (scale != previous) renderer->reset();
+        raysBefore = renderer->pathStats().rays;
+        Options frameOpts = opts;
+        frameOpts.samples = budget.samples();
+        return std::async(std::launch::async, [&, cam, renderer, frameOpts, scale]
+        {
+            renderer->render(pool, cam, *scene, frameOpts, opts.denoise ? Renderer::TileDone() : Renderer::TileDone(tileDone));
+            if (!opts.denoise) return;
+            renderer->denoise(pool, opts.denoise);
+            tileDone(Renderer::Tile{ 0, 0, size_t(budget.width(scale)), size_t(budget.height(scale)) });
+        });
+    };
+    std::future<void> frame = startFrame();
+    double frameStart = glfwGetTime();
 
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     glfwGetCursorPos(win, &xold, &yold);
-    size_t frames = 0;
+    size_t frames = 0, rendered = 0;
     double deltaTime, oldTime = glfwGetTime(), elapsed = 0.0;
 
+    // Time and rays spent tracing alone, apart from uploads and vsync
+    double traced = 0.0;
+    uint64_t rays = 0;
+    double samples = 0.0, pathLength = 0.0;
+
     while (!glfwWindowShouldClose(win))
     {
         deltaTime = glfwGetTime() - oldTime;
@@ -258,9 +741,17 @@ int main()
         if (elapsed > 1 - elapsed / ++frames / 2)
         {
             std::cout << "T = " << 1000.0 * elapsed / frames << " ms\t"
-                    << "FPS = " << frames / elapsed << std::endl;
+                    << "FPS = " << frames / elapsed << "\t"
+                    << "Res = " << budget.width(scale) << "x" << budget.height(scale) << "\t"
+                    << "SPP = " << samples << "\t"
+                    << "Rays/path = " << pathLength << "\t"
+                    << "Trace = " << (rendered ? 1000.0 * traced / rendered : 0.0) << " ms\t"
+                    << "Mrays/s = " << (traced > 0.0 ? rays / traced / 1e6 : 0.0) << std::endl;
             elapsed = 0.0;
             frames = 0;
+            rendered = 0;
+            traced = 0.0;
+            rays = 0;
         }
 
         glm::dvec3 input;
@@ -272,22 +763,82 @@ int main()
                || glfwGetKey(win, GLFW_KEY_CAPS_LOCK));
         input.z = glfwGetKey(win, GLFW_KEY_W)
                 - glfwGetKey(win, GLFW_KEY_S);
-        // TODO
+        cam.turn(xmoved, ymoved);
+        cam.move(input, deltaTime);
+        xmoved = ymoved = 0.0;
 
         glClear(GL_COLOR_BUFFER_BIT); // | GL_DEPTH_BUFFER_BIT);
 
-        GLubyte* pixels = draw();
-        texture.fill(WIN_W, WIN_H, pixels);
-        delete[] pixels;
+        // Checked first, so every tile of a complete frame is among those taken
+        // A frame at another scale than the one shown is uploaded whole once complete,
+        // as its tiles would otherwise land amid the last frame's
+        const bool complete = frame.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        if (complete && scale != shownScale)
+        {
+            texture.crop(budget.width(scale), budget.height(scale));
+            shownScale = scale;
+        }
+        if (scale == shownScale)
+        {
+            std::lock_guard<std::mutex> guard(finishedLock);
+            uploading.swap(finished);
+        }
+
+        if (!uploading.empty())
+        {
+            PROFILE_SCOPE("upload");
+            const Renderer& renderer = rendererAt(scale);
+            const std::vector<float>& shown = opts.denoise ? renderer.denoised() : renderer.image();
+            // A buffer that cannot be mapped skips this upload entirely
+            GLubyte* bytes = texture.map();
+            if (bytes)
+            {
+                for (const TextureRect& r : uploading)
+                {
+                    toDisplay(shown, budget.width(scale), r.x, r.y, r.x + r.width, r.y + r.height, bytes);
+                }
+                texture.upload(uploading);
+            }
+            uploading.clear();
+        }
+
+        if (complete)
+        {
+            frame.get();
+            const double took = glfwGetTime() - frameStart;
+            traced += took;
+            ++rendered;
+
+            // Moving the camera restarts the count
+            const Renderer& renderer = rendererAt(scale);
+            const PathStats stats = renderer.pathStats();
+            rays += stats.rays >= raysBefore ? stats.rays - raysBefore : stats.rays;
+            samples = renderer.sampleCount();
+            pathLength = stats.averageLength();
+
+            budget.finished(took, !(cam == frameCam));
+
+            frame = startFrame();
+            frameStart = glfwGetTime();
+        }
+        else if (!VSYNC && uploading.empty())
+        {
+            // Nothing to show yet, so leave the cores to the tracer
+            frame.wait_for(std::chrono::milliseconds(1));
+        }
 
         texture.bind();
         shader.use();
         texture.draw();
 
-        glfwSwapBuffers(win);
+        {
+            PROFILE_SCOPE("present");
+            glfwSwapBuffers(win);
+        }
         glfwPollEvents();
     }
 
+    frame.wait();
     glfwTerminate();
-    return 0;
+    return reportProfile(opts, 0);
 }
@@ -0,0 +1,165 @@
+#ifndef MAPPING_H_
+#define MAPPING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+// These clash with names used elsewhere
+#undef near
+#undef far
+#undef NEAR
+#undef FAR
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A whole file mapped read only, so pages are only read in as they are touched
+class MappedFile
+{ public:
+
+    MappedFile() { }
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Returns false if the file cannot be opened or is empty
+    bool open(const std::string& path)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+        {
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        }
+        if (mapping) bytes = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!bytes)
+        {
+            close();
+            return false;
+        }
+        length = size.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void* view = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (view == MAP_FAILED) return false;
+        bytes = static_cast<const uint8_t*>(view);
+        length = info.st_size;
+#endif
+        return true;
+    }
+
+    const uint8_t* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+
+    const uint8_t* bytes = nullptr;
+    size_t length = 0;
+
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+    void close()
+    {
+#ifdef _WIN32
+        if (bytes) UnmapViewOfFile(bytes);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (bytes) munmap(const_cast<uint8_t*>(bytes), length);
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+};
+
+// Size, modification time and identity of a file, which change whenever it is rewritten
+// The time is in nanoseconds where the system keeps them, as an edit can land within the same second
+struct FileStamp
+{
+    uint64_t size;
+    int64_t time;
+    uint64_t node;
+
+    // Returns false if the file does not exist
+    bool read(const std::string& path)
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                  nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        BY_HANDLE_FILE_INFORMATION info;
+        const bool found = GetFileInformationByHandle(file, &info) != 0;
+        CloseHandle(file);
+        if (!found) return false;
+        size = uint64_t(info.nFileSizeHigh) << 32 | info.nFileSizeLow;
+        time = uint64_t(info.ftLastWriteTime.dwHighDateTime) << 32 | info.ftLastWriteTime.dwLowDateTime;
+        node = uint64_t(info.nFileIndexHigh) << 32 | info.nFileIndexLow;
+#else
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) return false;
+        size = info.st_size;
+#ifdef __APPLE__
+        time = int64_t(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+        time = int64_t(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+        node = info.st_ino;
+#endif
+        return true;
+    }
+
+    bool operator==(const FileStamp& other) const
+    {
+        return size == other.size && time == other.time && node == other.node;
+    }
+};
+
+// Number of this process, to keep files it writes apart from those of others
+inline unsigned long processId()
+{
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return getpid();
+#endif
+}
+
+// Moves a finished file over another in one step, so readers see either the old or the new
+// one whole, and those with the old one mapped keep it
+inline bool replaceFile(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+#endif
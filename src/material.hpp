@@ -1,85 +1,160 @@
 #ifndef MATERIAL_H_
 #define MATERIAL_H_
 
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "profile.hpp"
 #include "surface.hpp"
 #include "utility.hpp"
 #include "config.hpp"
 
-// Base
+enum MaterialType : uint32_t { DIFFUSE, METAL, DIELECTRIC, EMISSIVE };
+
+// Everything a material needs to scatter, as stored in a MaterialTable
+struct MaterialData
+{
+    MaterialType type;
+    Vec3 albedo; // Emitted radiance, for Emissive
+    Real fuzz;  // Metal only
+    Real index; // Dielectric only
+};
+
+// Base, which scenes are described with before their materials are put in a table
 class Material
 { public:
 
-    virtual bool scatter(const Ray& in, const RayHit& hit, glm::dvec3& atten, Ray& scattered) const = 0;
+    MaterialData data;
+
+protected:
+
+    Material(MaterialType type, const Vec3& albedo) : data{ type, albedo, 0, 1 } { }
 };
 
 // Standard
 class Diffuse : public Material
 { public:
 
-    glm::dvec3 albedo;
-
-    Diffuse(const glm::dvec3 albedo) : albedo(albedo) { }
-
-    virtual bool scatter(const Ray& in, const RayHit& hit, glm::dvec3& atten, Ray& scattered) const
-    {
-        glm::dvec3 bounced;
-        if (LAMBERTIAN) bounced = hit.norm + randomUnit();
-        else bounced = randomHemi(hit.norm);
-        scattered = Ray(hit.point, bounced);
-        atten = albedo;
-        return true;
-    }
-
-    // TODO Could scatter with probability p and have atten be albedo / p
+    Diffuse(const Vec3 albedo) : Material(DIFFUSE, albedo) { }
 };
 
 // Metallic
 class Metal : public Material
 { public:
 
-    glm::dvec3 albedo;
-    double fuzz;
+    Metal(const Vec3 albedo, Real fuzz) : Material(METAL, albedo) { data.fuzz = fuzz; }
+};
 
-    Metal(const glm::dvec3 albedo, const double& fuzz) : albedo(albedo), fuzz(fuzz) { }
+// Refracts
+class Dielectric : public Material
+{ public:
 
-    virtual bool scatter(const Ray& in, const RayHit& hit, glm::dvec3& atten, Ray& scattered) const
+    Dielectric(Real index) : Material(DIELECTRIC, Vec3(1)) { data.index = index; }
+};
+
+// Gives off light, and absorbs any that arrives
+class Emissive : public Material
+{ public:
+
+    Emissive(const Vec3 radiance) : Material(EMISSIVE, radiance) { }
+};
+
+// Density of scatterDiffuse choosing a unit direction
+inline Real diffusePdf(const RayHit& hit, const Vec3& dir)
+{
+    if (!LAMBERTIAN) return glm::dot(dir, hit.norm) > 0 ? Real(0.5) / glm::pi<Real>() : Real(0);
+    return glm::max(glm::dot(dir, hit.norm), Real(0)) / glm::pi<Real>();
+}
+
+inline bool scatterDiffuse(const MaterialData& m, const RayHit& hit, Vec3& atten, Ray& scattered)
+{
+    Vec3 bounced;
+    if (LAMBERTIAN) bounced = hit.norm + randomUnit();
+    else bounced = randomHemi(hit.norm);
+    scattered = hit.spawn(bounced);
+    atten = m.albedo;
+    return true;
+}
+
+inline bool scatterMetal(const MaterialData& m, const Ray& in, const RayHit& hit, Vec3& atten, Ray& scattered)
+{
+    Vec3 reflected = glm::reflect(glm::normalize(in.dir), hit.norm);
+    scattered = hit.spawn(reflected + m.fuzz * randomUnit());
+    atten = m.albedo;
+    return dot(scattered.dir, hit.norm) > 0;
+}
+
+inline bool scatterDielectric(const MaterialData& m, const Ray& in, const RayHit& hit, Vec3& atten, Ray& scattered)
+{
+    atten = Vec3(1);
+    Real eta = hit.front ? 1 / m.index : m.index;
+    Vec3 dir = glm::normalize(in.dir);
+    Real cosTheta = glm::min(-dot(dir, hit.norm), Real(1));
+    Real sinTheta = glm::sqrt(1 - cosTheta * cosTheta);
+
+    Real prob = schlick(cosTheta, eta);
+    if (eta * sinTheta > 1 || randomDouble() < prob)
     {
-        glm::dvec3 reflected = glm::reflect(glm::normalize(in.dir), hit.norm);
-        scattered = Ray(hit.point, reflected + fuzz * randomUnit());
-        atten = albedo;
-        return dot(scattered.dir, hit.norm) > 0.0;
+        dir = glm::reflect(dir, hit.norm);
+    }
+    else
+    {
+        dir = glm::refract(dir, hit.norm, eta);
     }
-};
 
-// Refracts
-class Dielectric : public Material
+    scattered = hit.spawn(dir);
+    return true;
+}
+
+// Every material of a scene in one array, which surfaces and hits refer to by index
+class MaterialTable
 { public:
 
-    double index;
+    // Returns the index of a material, adding it on first sight
+    uint32_t add(const std::shared_ptr<Material>& material)
+    {
+        auto found = lookup.find(material.get());
+        if (found != lookup.end()) return found->second;
+        return lookup[material.get()] = add(material->data);
+    }
+
+    // Adds a record as it is, such as one read from a scene file
+    uint32_t add(const MaterialData& data)
+    {
+        records.push_back(data);
+        return records.size() - 1;
+    }
 
-    Dielectric(double index) : index(index) {}
+    size_t size() const { return records.size(); }
+    const MaterialData* data() const { return records.data(); }
 
-    virtual bool scatter(const Ray& in, const RayHit& hit, glm::dvec3& atten, Ray& scattered) const
+    const MaterialData& operator[](uint32_t mat) const { return records[mat]; }
+
+    bool scatter(const Ray& in, const RayHit& hit, Vec3& atten, Ray& scattered) const
     {
-        atten = glm::dvec3(1.0);
-        double eta = hit.front ? 1.0 / index : index;
-        glm::dvec3 dir = glm::normalize(in.dir);
-        double cosTheta = glm::min(-dot(dir, hit.norm), 1.0);
-        double sinTheta = glm::sqrt(1.0 - cosTheta * cosTheta);
-
-        double prob = schlick(cosTheta, eta);
-        if (eta * sinTheta > 1.0 || random() < prob)
+        const MaterialData& m = records[hit.mat];
+        switch (m.type)
         {
-            dir = glm::reflect(dir, hit.norm);
+            case DIFFUSE:
+                PROFILE_COUNT(SCATTER_DIFFUSE);
+                return scatterDiffuse(m, hit, atten, scattered);
+            case METAL:
+                PROFILE_COUNT(SCATTER_METAL);
+                return scatterMetal(m, in, hit, atten, scattered);
+            case DIELECTRIC:
+                PROFILE_COUNT(SCATTER_DIELECTRIC);
+                return scatterDielectric(m, in, hit, atten, scattered);
+            case EMISSIVE:
+                return false;
         }
-        else
-        {
-            dir = glm::refract(dir, hit.norm, eta);
-        }
-
-        scattered = Ray(hit.point, dir);
-        return true;
+        return false;
     }
+
+private:
+
+    std::vector<MaterialData> records;
+    std::unordered_map<const Material*, uint32_t> lookup;
 };
 
 #endif
@@ -0,0 +1,221 @@
+#ifndef MESH_H_
+#define MESH_H_
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "bvh.hpp"
+#include "profile.hpp"
+#include "surface.hpp"
+
+// Leaves hold up to this many triangles
+static const uint32_t MESH_LEAF_MAX = 4;
+
+// Rounding steps a triangle's hit point may stray, in units of its corners' coordinates
+static const Real TRIANGLE_ERROR_ULPS = 8;
+
+// Marks a corner without a normal
+static const uint32_t NO_NORMAL = UINT32_MAX;
+
+// A ray direction sheared and permuted so it runs along +z, set up once per ray
+struct ShearedRay
+{
+    int kx, ky, kz;
+    Real sx, sy, sz;
+
+    ShearedRay(const Vec3& dir)
+    {
+        const Vec3 size = glm::abs(dir);
+        kz = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+        kx = (kz + 1) % 3;
+        ky = (kx + 1) % 3;
+
+        // Keeps the winding of triangles the same after the permutation
+        if (dir[kz] < 0) std::swap(kx, ky);
+        sx = dir[kx] / dir[kz];
+        sy = dir[ky] / dir[kz];
+        sz = 1 / dir[kz];
+    }
+};
+
+// Twice the signed area between the ray and the edge from p to q, in the ray's frame
+// Both triangles sharing an edge work it out in the same vertex order, so rounding, fused
+// multiply-adds included, gives them exactly opposite values and no crack between them
+template <typename T>
+T edgeFunction(T px, T py, T qx, T qy)
+{
+    if (px < qx || (px == qx && py < qy)) return px * qy - py * qx;
+    return -(qx * py - qy * px);
+}
+
+// Woop, Benthin and Wald's watertight test, which finds the edges in the ray's own frame so a
+// ray through a shared edge or corner hits exactly one of the triangles sharing it
+// Gives t and the weight of each corner
+inline bool triangleHit(const Ray& ray, const ShearedRay& s, const Vec3& p0, const Vec3& p1, const Vec3& p2,
+                        Real tMin, Real tMax, Real& t, Vec3& weights)
+{
+    const Vec3 a = p0 - ray.org, b = p1 - ray.org, c = p2 - ray.org;
+    const Real ax = a[s.kx] - s.sx * a[s.kz], ay = a[s.ky] - s.sy * a[s.kz];
+    const Real bx = b[s.kx] - s.sx * b[s.kz], by = b[s.ky] - s.sy * b[s.kz];
+    const Real cx = c[s.kx] - s.sx * c[s.kz], cy = c[s.ky] - s.sy * c[s.kz];
+
+    Real u = edgeFunction(cx, cy, bx, by);
+    Real v = edgeFunction(ax, ay, cx, cy);
+    Real w = edgeFunction(bx, by, ax, ay);
+
+    // Edges through the ray itself are settled in double, so none is counted twice
+    if (FLOAT_PRECISION && (u == 0 || v == 0 || w == 0))
+    {
+        u = Real(edgeFunction<double>(cx, cy, bx, by));
+        v = Real(edgeFunction<double>(ax, ay, cx, cy));
+        w = Real(edgeFunction<double>(bx, by, ax, ay));
+    }
+
+    if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0)) return false;
+    const Real det = u + v + w;
+    if (det == 0) return false;
+
+    const Real depth = u * (s.sz * a[s.kz]) + v * (s.sz * b[s.kz]) + w * (s.sz * c[s.kz]);
+    const Real inv = 1 / det;
+    t = depth * inv;
+    if (!(t > tMin && t < tMax)) return false;
+    weights = Vec3(u, v, w) * inv;
+    return true;
+}
+
+// Indexed triangles with their own BVH, sharing one material
+class TriangleMesh: public Surface
+{ public:
+
+    std::vector<Vec3> positions;
+    std::vector<Vec3> normals;
+
+    // Three corners per triangle, into positions and into normals
+    // Normal indices are empty for a faceted mesh
+    std::vector<uint32_t> vertexIndex;
+    std::vector<uint32_t> normalIndex;
+
+    // Index into the scene's MaterialTable
+    uint32_t mat = 0;
+
+    size_t size() const { return vertexIndex.size() / 3; }
+
+    // Builds the hierarchy and puts the triangles in leaf order, after which none may be added
+    void build()
+    {
+        const size_t n = size();
+        {
+            std::vector<AABB> boxes(n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                for (int k = 0; k < 3; ++k) boxes[i].grow(positions[vertexIndex[i * 3 + k]]);
+            }
+            tree.build(boxes, MESH_LEAF_MAX);
+        }
+
+        permute(vertexIndex);
+        permute(normalIndex);
+        std::vector<uint32_t>().swap(tree.order);
+    }
+
+    bool hit(const Ray& ray, Real tMin, Real tMax, RayHit& hit) const
+    {
+        const ShearedRay sheared(ray.dir);
+        long best = -1;
+        Real t = tMax;
+        Vec3 weights;
+
+        tree.traverse(ray, tMin, tMax, [&](uint32_t start, uint32_t count, Real& closest)
+        {
+            bool found = false;
+            PROFILE_ADD(TRIANGLE_TESTS, count);
+            for (uint32_t i = start; i < start + count; ++i)
+            {
+                const uint32_t* v = &vertexIndex[i * 3];
+                Real candidate;
+                Vec3 w;
+                if (triangleHit(ray, sheared, positions[v[0]], positions[v[1]], positions[v[2]],
+                                tMin, closest, candidate, w))
+                {
+                    closest = t = candidate;
+                    weights = w;
+                    best = i;
+                    found = true;
+                }
+            }
+            return found;
+        });
+        if (best < 0) return false;
+
+        // Only the closest triangle gets a full hit record
+        const uint32_t* v = &vertexIndex[best * 3];
+        const Vec3& p0 = positions[v[0]];
+        const Vec3& p1 = positions[v[1]];
+        const Vec3& p2 = positions[v[2]];
+        const Vec3 bound = glm::abs(weights.x * p0) + glm::abs(weights.y * p1) + glm::abs(weights.z * p2);
+        hit.t = t;
+        hit.point = weights.x * p0 + weights.y * p1 + weights.z * p2;
+        hit.error = TRIANGLE_ERROR_ULPS * EPSILON * glm::max(bound.x, glm::max(bound.y, bound.z));
+        hit.mat = mat;
+
+        Vec3 norm = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+        const uint32_t* n = normalIndex.empty() ? nullptr : &normalIndex[best * 3];
+        if (!n || n[0] == NO_NORMAL || n[1] == NO_NORMAL || n[2] == NO_NORMAL)
+        {
+            hit.setNorm(ray, norm);
+            return true;
+        }
+
+        // Shading normals decide which side is outside, whatever the winding
+        Vec3 shading = glm::normalize(weights.x * normals[n[0]] + weights.y * normals[n[1]] + weights.z * normals[n[2]]);
+        if (glm::dot(norm, shading) < 0) norm = -norm;
+        hit.setNorm(ray, norm);
+        if (!hit.front) shading = -shading;
+
+        // The offset goes along the shading normal, so it must be longer to clear the surface
+        hit.error /= glm::max(glm::dot(shading, hit.norm), Real(0.1));
+        hit.norm = shading;
+        return true;
+    }
+
+    bool occluded(const Ray& ray, Real tMin, Real tMax) const
+    {
+        const ShearedRay sheared(ray.dir);
+        return tree.any(ray, tMin, tMax, [&](uint32_t start, uint32_t count)
+        {
+            PROFILE_ADD(TRIANGLE_TESTS, count);
+            for (uint32_t i = start; i < start + count; ++i)
+            {
+                const uint32_t* v = &vertexIndex[i * 3];
+                Real t;
+                Vec3 w;
+                if (triangleHit(ray, sheared, positions[v[0]], positions[v[1]], positions[v[2]], tMin, tMax, t, w)) return true;
+            }
+            return false;
+        });
+    }
+
+    bool bounds(AABB& box) const
+    {
+        box = tree.bounds();
+        return size() > 0;
+    }
+
+private:
+
+    BVHTree tree;
+
+    // Reorders triangles, three values at a time, to match the tree
+    void permute(std::vector<uint32_t>& corners) const
+    {
+        if (corners.empty()) return;
+        std::vector<uint32_t> sorted(corners.size());
+        for (size_t i = 0; i < tree.order.size(); ++i)
+        {
+            for (int k = 0; k < 3; ++k) sorted[i * 3 + k] = corners[tree.order[i] * 3 + k];
+        }
+        corners.swap(sorted);
+    }
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef OBJ_H_
+#define OBJ_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "lines.hpp"
+#include "mesh.hpp"
+
+// Resolves one OBJ index, which counts from 1, or back from the end if negative
+// Returns false if it names an element not yet read
+inline bool objIndex(long index, size_t count, uint32_t& resolved)
+{
+    if (index < 0) index += long(count);
+    else --index;
+    if (index < 0 || size_t(index) >= count) return false;
+    resolved = uint32_t(index);
+    return true;
+}
+
+// Reads the triangles of a Wavefront OBJ file into one mesh, streaming it a block at a time
+// so nothing but the mesh's own arrays grows with the file
+// Polygons are split into fans, and texture coordinates, groups and materials are skipped
+inline std::shared_ptr<TriangleMesh> loadOBJ(const std::string& path, uint32_t mat)
+{
+    auto mesh = std::make_shared<TriangleMesh>();
+    mesh->mat = mat;
+    bool anyNormals = false;
+    std::string word;
+
+    const bool read = readLines(path, [&](TextLine& line, std::string& problem)
+    {
+        if (!line.word(word)) return true;
+
+        if (word == "v" || word == "vn")
+        {
+            Vec3 p;
+            if (!line.number(p.x) || !line.number(p.y) || !line.number(p.z))
+            {
+                problem = "Bad " + word;
+                return false;
+            }
+            if (word == "v") mesh->positions.push_back(p);
+            else mesh->normals.push_back(p);
+
+            // Positions may carry a fourth weight or a colour, which are ignored
+            return true;
+        }
+        if (word != "f") return true;
+
+        // Each corner is v, v/vt, v//vn or v/vt/vn
+        uint32_t first[2] = { }, previous[2] = { };
+        int corners = 0;
+        while (line.word(word))
+        {
+            char* at;
+            uint32_t corner[2] = { 0, NO_NORMAL };
+            if (!objIndex(std::strtol(word.c_str(), &at, 10), mesh->positions.size(), corner[0]))
+            {
+                problem = "Bad vertex in face " + word;
+                return false;
+            }
+            if (*at == '/' && *++at != '/') std::strtol(at, &at, 10);
+            if (*at == '/' && *++at)
+            {
+                if (!objIndex(std::strtol(at, &at, 10), mesh->normals.size(), corner[1]))
+                {
+                    problem = "Bad normal in face " + word;
+                    return false;
+                }
+                anyNormals = true;
+            }
+
+            if (corners == 0) std::copy(corner, corner + 2, first);
+            else if (corners >= 2)
+            {
+                for (const uint32_t* c : { first, previous, corner })
+                {
+                    mesh->vertexIndex.push_back(c[0]);
+                    mesh->normalIndex.push_back(c[1]);
+                }
+            }
+            std::copy(corner, corner + 2, previous);
+            ++corners;
+        }
+
+        if (corners < 3)
+        {
+            problem = "Face with fewer than three corners";
+            return false;
+        }
+        return true;
+    });
+    if (!read) return nullptr;
+
+    // An empty mesh has no bounds to place it by
+    if (mesh->vertexIndex.empty())
+    {
+        std::cerr << "ERROR: Mesh " << path << " has no triangles" << std::endl;
+        return nullptr;
+    }
+
+    // Faceted meshes keep no normal indices at all
+    if (!anyNormals)
+    {
+        std::vector<uint32_t>().swap(mesh->normalIndex);
+        std::vector<Vec3>().swap(mesh->normals);
+    }
+
+    mesh->build();
+    return mesh;
+}
+
+#endif
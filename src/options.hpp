@@ -0,0 +1,225 @@
+#ifndef OPTIONS_H_
+#define OPTIONS_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "config.hpp"
+
+// Command line settings, defaulting to those in config.hpp
+struct Options
+{
+    // Render once without a window and save the result
+    bool headless = false;
+    bool bvhReport = false;
+    bool benchPrimary = false;
+
+    // Run the benchmark suite, checking it against an earlier run's results if given
+    bool bench = false;
+    std::string baseline;
+
+    // Two PFM images to compare instead of rendering
+    std::string diff[2];
+
+    // Scene file to render instead of the random spheres, and where to write the scene as text
+    std::string scene;
+    std::string saveScene;
+
+    int width = WIN_W;
+    int height = WIN_H;
+    int samples = AA_X;
+    double threshold = ADAPT_THRESHOLD;
+    int maxSamples = ADAPT_MAX_SPP;
+    int budget = 0;
+    int frameTime = FRAME_TIME;
+    int depth = RAY_DEPTH;
+    int rouletteDepth = RR_DEPTH;
+    double rouletteFloor = RR_FLOOR;
+    uint32_t seed = SEED;
+    int threads = THREADS;
+    bool packets = PACKETS;
+    bool wavefront = WAVEFRONT;
+    std::string sampler = SAMPLER;
+    int denoise = DENOISE;
+    bool reproject = REPROJECT;
+
+    // Address to hand out jobs on, or to take them from, as unix:PATH or HOST:PORT
+    std::string serve;
+    std::string join;
+
+    // Samples of a tile in each distributed job, 0 for all of them
+    int jobSamples = 0;
+
+    // Chrome trace of the timed scopes, written at exit by instrumented builds
+    std::string trace;
+
+    // Format follows the extension, and "-" streams PPM to stdout
+    std::string output = "render.png";
+
+    // Returns false if the arguments could not be understood
+    bool parse(int argc, char* argv[])
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (arg == "--headless") headless = true;
+            else if (arg == "--bvh-report") bvhReport = true;
+            else if (arg == "--bench-primary") benchPrimary = true;
+            else if (arg == "--bench") bench = true;
+            else if (arg == "--help" || arg == "-h") return usage();
+            else if (!hasValue) return usage("Missing value for " + arg);
+            else if (arg == "--diff")
+            {
+                if (i + 2 >= argc) return usage("Missing value for " + arg);
+                diff[0] = argv[++i];
+                diff[1] = argv[++i];
+            }
+            else if (arg == "--width" || arg == "-w") { if (!number(argv[++i], 1, width)) return usage(arg); }
+            else if (arg == "--height") { if (!number(argv[++i], 1, height)) return usage(arg); }
+            else if (arg == "--spp" || arg == "-s") { if (!number(argv[++i], 1, samples)) return usage(arg); }
+            else if (arg == "--threshold") { if (!real(argv[++i], 0.0, 1.0, threshold)) return usage(arg); }
+            else if (arg == "--max-spp") { if (!number(argv[++i], 1, maxSamples)) return usage(arg); }
+            else if (arg == "--budget") { if (!number(argv[++i], 0, budget)) return usage(arg); }
+            else if (arg == "--frame-ms") { if (!number(argv[++i], 0, frameTime)) return usage(arg); }
+            else if (arg == "--depth" || arg == "-d") { if (!number(argv[++i], 1, depth)) return usage(arg); }
+            else if (arg == "--rr-depth") { if (!number(argv[++i], 0, rouletteDepth)) return usage(arg); }
+            else if (arg == "--rr-floor") { if (!real(argv[++i], 0.001, 1.0, rouletteFloor)) return usage(arg); }
+            else if (arg == "--denoise") { if (!number(argv[++i], 0, denoise)) return usage(arg); }
+            else if (arg == "--threads" || arg == "-t") { if (!number(argv[++i], 0, threads)) return usage(arg); }
+            else if (arg == "--seed")
+            {
+                int value;
+                if (!number(argv[++i], 0, value)) return usage(arg);
+                seed = value;
+            }
+            else if (arg == "--packets")
+            {
+                int value;
+                if (!number(argv[++i], 0, value)) return usage(arg);
+                packets = value;
+            }
+            else if (arg == "--wavefront")
+            {
+                int value;
+                if (!number(argv[++i], 0, value)) return usage(arg);
+                wavefront = value;
+            }
+            else if (arg == "--reproject")
+            {
+                int value;
+                if (!number(argv[++i], 0, value)) return usage(arg);
+                reproject = value;
+            }
+            else if (arg == "--sampler")
+            {
+                sampler = argv[++i];
+                if (sampler != "random" && sampler != "sobol" && sampler != "halton" && sampler != "bluenoise")
+                {
+                    return usage(arg);
+                }
+            }
+            else if (arg == "--output" || arg == "-o") output = argv[++i];
+            else if (arg == "--scene") scene = argv[++i];
+            else if (arg == "--save-scene") saveScene = argv[++i];
+            else if (arg == "--baseline") baseline = argv[++i];
+            else if (arg == "--serve") serve = argv[++i];
+            else if (arg == "--join") join = argv[++i];
+            else if (arg == "--job-spp") { if (!number(argv[++i], 0, jobSamples)) return usage(arg); }
+            else if (arg == "--trace")
+            {
+                if (!INSTRUMENT) return usage("--trace needs a build with -DINSTRUMENT=1");
+                trace = argv[++i];
+            }
+            else return usage("Unknown argument " + arg);
+        }
+        return true;
+    }
+
+    // The settings that decide what a render looks like, as arguments parse would take
+    std::vector<std::string> arguments() const
+    {
+        return {
+            "--width", std::to_string(width), "--height", std::to_string(height),
+            "--spp", std::to_string(samples), "--depth", std::to_string(depth),
+            "--rr-depth", std::to_string(rouletteDepth), "--rr-floor", exact(rouletteFloor),
+            "--seed", std::to_string(seed), "--sampler", sampler,
+            "--packets", std::to_string(int(packets)), "--wavefront", std::to_string(int(wavefront)),
+            "--scene", scene
+        };
+    }
+
+private:
+
+    // Writes a real number so that it reads back the same
+    static std::string exact(double value)
+    {
+        std::ostringstream text;
+        text.precision(17);
+        text << value;
+        return text.str();
+    }
+
+    // Parses a whole integer no smaller than min
+    static bool number(const char* text, int min, int& value)
+    {
+        char* end;
+        long parsed = std::strtol(text, &end, 10);
+        if (*text == '\0' || *end != '\0' || parsed < min || parsed > INT32_MAX) return false;
+        value = parsed;
+        return true;
+    }
+
+    // Parses a real number within [min, max]
+    static bool real(const char* text, double min, double max, double& value)
+    {
+        char* end;
+        double parsed = std::strtod(text, &end);
+        if (*text == '\0' || *end != '\0' || !(parsed >= min && parsed <= max)) return false;
+        value = parsed;
+        return true;
+    }
+
+    static bool usage(const std::string& problem = "")
+    {
+        if (!problem.empty()) std::cerr << "ERROR: Bad argument: " << problem << "\n";
+        std::cerr << "Usage: launch [options]\n"
+                  << "  --headless          Render once without a window\n"
+                  << "  -o, --output FILE   Image to write, .ppm .png or .pfm (- for PPM on stdout)\n"
+                  << "      --scene FILE    Scene to render, cached beside it as FILE.cache\n"
+                  << "      --save-scene FILE Write the scene out in the text format and exit\n"
+                  << "  -w, --width N       Image width\n"
+                  << "      --height N      Image height\n"
+                  << "  -s, --spp N         Samples per pixel\n"
+                  << "      --threshold E   Keep sampling pixels whose displayed noise is above E, 0 for even sampling\n"
+                  << "      --max-spp N     Most samples for one pixel when sampling adaptively\n"
+                  << "      --budget MS     Start no adaptive pass after this many ms, 0 for no limit\n"
+                  << "      --frame-ms MS   Window frames drop resolution while moving to trace in MS, 0 for full\n"
+                  << "      --sampler NAME  random, sobol, halton or bluenoise\n"
+                  << "  -d, --depth N       Maximum bounces per path\n"
+                  << "      --rr-depth N    Bounces before Russian roulette starts\n"
+                  << "      --rr-floor P    Lowest chance of surviving Russian roulette\n"
+                  << "      --denoise N     Denoiser passes over the finished image, 0 for none\n"
+                  << "      --reproject 0|1 Keep samples through camera moves in the window\n"
+                  << "      --seed N        Scene and sampling seed\n"
+                  << "  -t, --threads N     Render threads, 0 for all\n"
+                  << "      --packets 0|1   Trace primary rays in packets\n"
+                  << "      --wavefront 0|1 Trace each tile's paths in lockstep stages\n"
+                  << "      --bvh-report    Time BVH builds and traversal on large scenes\n"
+                  << "      --bench-primary Compare primary ray throughput with and without packets\n"
+                  << "      --bench         Time the fixed benchmark scenes and print the results as JSON\n"
+                  << "      --baseline FILE Results of an earlier --bench to flag regressions against\n"
+                  << "      --serve ADDRESS Hand out tiles to --join processes and save their merged image\n"
+                  << "      --join ADDRESS  Render tiles for a --serve process, taking its settings\n"
+                  << "      --job-spp N     Samples of a tile in each distributed job, 0 for all\n"
+                  << "      --trace FILE    Write timed scopes for chrome://tracing, if built with -DINSTRUMENT=1\n"
+                  << "      --diff A B      Compare two .pfm images, such as float and double renders\n";
+        return false;
+    }
+};
+
+#endif
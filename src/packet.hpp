@@ -0,0 +1,85 @@
+#ifndef PACKET_H_
+#define PACKET_H_
+
+#include <cstdint>
+#include <utility>
+#include <glm/glm.hpp>
+#include "aabb.hpp"
+#include "ray.hpp"
+
+// Rays traced together, kept as arrays so each loop over lanes vectorises
+static const int PACKET_SIZE = 8;
+
+struct RayPacket
+{
+    alignas(64) Real ox[PACKET_SIZE];
+    alignas(64) Real oy[PACKET_SIZE];
+    alignas(64) Real oz[PACKET_SIZE];
+    alignas(64) Real dx[PACKET_SIZE];
+    alignas(64) Real dy[PACKET_SIZE];
+    alignas(64) Real dz[PACKET_SIZE];
+
+    // Reciprocal directions for box tests
+    alignas(64) Real ix[PACKET_SIZE];
+    alignas(64) Real iy[PACKET_SIZE];
+    alignas(64) Real iz[PACKET_SIZE];
+
+    // Shortened as closer hits are found
+    alignas(64) Real tMax[PACKET_SIZE];
+    Real tMin;
+
+    // One bit per lane holding a ray
+    uint32_t active;
+
+    void clear(Real tMin)
+    {
+        this->tMin = tMin;
+        active = 0;
+    }
+
+    void set(int i, const Ray& ray, Real far)
+    {
+        ox[i] = ray.org.x;
+        oy[i] = ray.org.y;
+        oz[i] = ray.org.z;
+        dx[i] = ray.dir.x;
+        dy[i] = ray.dir.y;
+        dz[i] = ray.dir.z;
+        ix[i] = 1 / ray.dir.x;
+        iy[i] = 1 / ray.dir.y;
+        iz[i] = 1 / ray.dir.z;
+        tMax[i] = far;
+        active |= 1u << i;
+    }
+
+    Ray ray(int i) const
+    {
+        return Ray(Vec3(ox[i], oy[i], oz[i]), Vec3(dx[i], dy[i], dz[i]));
+    }
+
+    // Lanes whose rays enter the box before their closest hit so far
+    uint32_t hit(const AABB& box) const
+    {
+        uint32_t mask = 0;
+        for (int i = 0; i < PACKET_SIZE; ++i)
+        {
+            // Ordered as in AABB::hit, so NaN slabs are ignored
+            Real x0 = (box.lo.x - ox[i]) * ix[i], x1 = (box.hi.x - ox[i]) * ix[i];
+            Real y0 = (box.lo.y - oy[i]) * iy[i], y1 = (box.hi.y - oy[i]) * iy[i];
+            Real z0 = (box.lo.z - oz[i]) * iz[i], z1 = (box.hi.z - oz[i]) * iz[i];
+            if (ix[i] < 0) std::swap(x0, x1);
+            if (iy[i] < 0) std::swap(y0, y1);
+            if (iz[i] < 0) std::swap(z0, z1);
+            Real near = x0 > tMin ? x0 : tMin;
+            near = y0 > near ? y0 : near;
+            near = z0 > near ? z0 : near;
+            Real far = x1 * SLAB_ROUNDING < tMax[i] ? x1 * SLAB_ROUNDING : tMax[i];
+            far = y1 * SLAB_ROUNDING < far ? y1 * SLAB_ROUNDING : far;
+            far = z1 * SLAB_ROUNDING < far ? z1 * SLAB_ROUNDING : far;
+            mask |= uint32_t(near <= far) << i;
+        }
+        return mask & active;
+    }
+};
+
+#endif
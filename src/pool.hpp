@@ -0,0 +1,148 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool which runs batches of indexed tasks
+class Pool
+{ public:
+
+    // A task receives its index and the index of the worker running it
+    typedef std::function<void(size_t, size_t)> Task;
+
+    // Zero threads uses every hardware thread
+    Pool(size_t threads = 0) : queues(pickSize(threads))
+    {
+        for (size_t i = 0; i < queues.size(); ++i)
+        {
+            workers.emplace_back(&Pool::work, this, i);
+        }
+    }
+
+    ~Pool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    size_t size() const { return queues.size(); }
+
+    // Runs task(i, worker) for every i in [0, count) and waits for them all
+    void run(size_t count, const Task& task)
+    {
+        if (!count) return;
+        job = &task;
+        remaining = count;
+
+        // Deal out contiguous runs so neighbouring items start on one worker
+        const size_t n = queues.size();
+        for (size_t q = 0; q < n; ++q)
+        {
+            std::lock_guard<std::mutex> guard(queues[q].lock);
+            for (size_t i = count * q / n; i < count * (q + 1) / n; ++i)
+            {
+                queues[q].items.push_back(i);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            ++generation;
+        }
+        wake.notify_all();
+
+        std::unique_lock<std::mutex> guard(lock);
+        done.wait(guard, [this] { return remaining == 0; });
+    }
+
+private:
+
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<size_t> items;
+    };
+
+    std::vector<Queue> queues;
+    std::vector<std::thread> workers;
+
+    // Batch state
+    const Task* job = nullptr;
+    std::atomic<size_t> remaining{0};
+    size_t generation = 0;
+    bool stopping = false;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    static size_t pickSize(size_t threads)
+    {
+        if (threads) return threads;
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Takes the most recently queued item of a worker's own queue
+    bool pop(size_t id, size_t& item)
+    {
+        Queue& q = queues[id];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (q.items.empty()) return false;
+        item = q.items.back();
+        q.items.pop_back();
+        return true;
+    }
+
+    // Takes the oldest item from any other worker's queue
+    bool steal(size_t id, size_t& item)
+    {
+        for (size_t i = 1; i < queues.size(); ++i)
+        {
+            Queue& q = queues[(id + i) % queues.size()];
+            std::lock_guard<std::mutex> guard(q.lock);
+            if (q.items.empty()) continue;
+            item = q.items.front();
+            q.items.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    void work(size_t id)
+    {
+        size_t seen = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+
+            size_t item;
+            while (pop(id, item) || steal(id, item))
+            {
+                (*job)(item, id);
+                if (--remaining == 0)
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    done.notify_all();
+                }
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,261 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "config.hpp"
+
+// Counters and scoped timers for the hot paths, compiled out unless INSTRUMENT is set
+// Each thread counts into a record of its own, so counting is a plain increment
+
+enum ProfileCounter
+{
+    RAYS_TRACED,
+    SHADOW_RAYS,
+    BOX_TESTS,
+    PACKET_BOX_TESTS,
+    SPHERE_TESTS,
+    TRIANGLE_TESTS,
+    INSTANCE_TESTS,
+    SCATTER_DIFFUSE,
+    SCATTER_METAL,
+    SCATTER_DIELECTRIC,
+    PROFILE_COUNTERS
+};
+
+static const char* const PROFILE_COUNTER_NAMES[PROFILE_COUNTERS] = {
+    "rays traced", "shadow rays", "box tests", "packet box tests", "sphere tests", "triangle tests",
+    "instance tests", "diffuse scatters", "metal scatters", "dielectric scatters"
+};
+
+// Paths are counted by length up to the last bin, which holds every longer one
+static const int PROFILE_PATH_BINS = 64;
+
+// Timed scopes kept per thread, past which further ones are only counted
+static const size_t PROFILE_EVENT_MAX = 1 << 18;
+
+// One timed scope, in microseconds since the profiler started
+struct ProfileEvent
+{
+    const char* name;
+    double start;
+    double duration;
+    int64_t arg;
+};
+
+// What one thread has counted and timed
+struct ThreadProfile
+{
+    uint32_t id = 0;
+    uint64_t counts[PROFILE_COUNTERS] = { };
+    uint64_t pathLengths[PROFILE_PATH_BINS] = { };
+    std::vector<ProfileEvent> events;
+    uint64_t dropped = 0;
+
+    void path(int length)
+    {
+        ++pathLengths[std::min(std::max(length, 1), PROFILE_PATH_BINS) - 1];
+    }
+
+    void event(const char* name, double start, double duration, int64_t arg)
+    {
+        if (events.size() < PROFILE_EVENT_MAX) events.push_back(ProfileEvent{ name, start, duration, arg });
+        else ++dropped;
+    }
+};
+
+// Collects every thread's record, which outlives the thread so results can be read at exit
+// Totals are only meaningful while no thread is counting, such as between renders
+class Profiler
+{ public:
+
+    static Profiler& instance()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    // The calling thread's record, made on its first use
+    ThreadProfile& local()
+    {
+        thread_local ThreadProfile* record = nullptr;
+        if (!record)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            threads.emplace_back(new ThreadProfile());
+            record = threads.back().get();
+            record->id = threads.size() - 1;
+        }
+        return *record;
+    }
+
+    double now() const
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Totals of every counter, timer and path length, as a table
+    void summary(std::ostream& out)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        uint64_t counts[PROFILE_COUNTERS] = { };
+        uint64_t lengths[PROFILE_PATH_BINS] = { };
+        uint64_t dropped = 0;
+        std::map<std::string, Timing> timings;
+        for (const auto& t : threads)
+        {
+            for (int i = 0; i < PROFILE_COUNTERS; ++i) counts[i] += t->counts[i];
+            for (int i = 0; i < PROFILE_PATH_BINS; ++i) lengths[i] += t->pathLengths[i];
+            for (const ProfileEvent& e : t->events) timings[e.name].add(e.duration);
+            dropped += t->dropped;
+        }
+
+        const std::ios::fmtflags flags = out.flags();
+        const uint64_t rays = counts[RAYS_TRACED];
+        out << std::fixed << std::setprecision(3) << "\n"
+            << std::left << std::setw(22) << "counter" << std::right << std::setw(16) << "total" << std::setw(12) << "per ray" << "\n";
+        for (int i = 0; i < PROFILE_COUNTERS; ++i)
+        {
+            out << std::left << std::setw(22) << PROFILE_COUNTER_NAMES[i] << std::right << std::setw(16) << counts[i]
+                << std::setw(12) << (rays ? double(counts[i]) / rays : 0.0) << "\n";
+        }
+
+        out << "\n" << std::left << std::setw(22) << "timer" << std::right << std::setw(16) << "calls"
+            << std::setw(12) << "total ms" << std::setw(12) << "mean ms" << std::setw(12) << "max ms" << "\n";
+        for (const auto& entry : timings)
+        {
+            const Timing& t = entry.second;
+            out << std::left << std::setw(22) << entry.first << std::right << std::setw(16) << t.calls
+                << std::setw(12) << t.total / 1000.0 << std::setw(12) << t.total / t.calls / 1000.0
+                << std::setw(12) << t.longest / 1000.0 << "\n";
+        }
+        if (dropped) out << dropped << " timed scopes past the first " << PROFILE_EVENT_MAX << " per thread are left out\n";
+
+        uint64_t paths = 0, most = 0;
+        for (uint64_t n : lengths)
+        {
+            paths += n;
+            most = std::max(most, n);
+        }
+        if (paths)
+        {
+            out << "\n" << std::left << std::setw(22) << "rays per path" << std::right << std::setw(16) << "paths"
+                << std::setw(12) << "share" << "\n";
+            for (int i = 0; i < PROFILE_PATH_BINS; ++i)
+            {
+                if (!lengths[i]) continue;
+                const std::string label = std::to_string(i + 1) + (i + 1 == PROFILE_PATH_BINS ? "+" : "");
+                out << std::left << std::setw(22) << label << std::right << std::setw(16) << lengths[i]
+                    << std::setw(11) << 100.0 * lengths[i] / paths << "% "
+                    << std::string(size_t(40 * lengths[i] / most), '#') << "\n";
+            }
+        }
+        out.flags(flags);
+    }
+
+    // Writes every timed scope in the Chrome trace format, with the counter totals alongside
+    bool writeTrace(const std::string& path)
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            std::cerr << "ERROR: Cannot open " << path << std::endl;
+            return false;
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        uint64_t counts[PROFILE_COUNTERS] = { };
+        file << std::fixed << std::setprecision(3) << "{\"traceEvents\": [\n";
+        bool first = true;
+        for (const auto& t : threads)
+        {
+            for (int i = 0; i < PROFILE_COUNTERS; ++i) counts[i] += t->counts[i];
+            file << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << t->id
+                 << ", \"args\": {\"name\": \"" << (t->id ? "worker " + std::to_string(t->id) : std::string("main")) << "\"}}";
+            first = false;
+            for (const ProfileEvent& e : t->events)
+            {
+                file << ",\n{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << t->id
+                     << ", \"ts\": " << e.start << ", \"dur\": " << e.duration;
+                if (e.arg >= 0) file << ", \"args\": {\"index\": " << e.arg << "}";
+                file << "}";
+            }
+        }
+
+        file << "\n], \"displayTimeUnit\": \"ms\", \"otherData\": {";
+        for (int i = 0; i < PROFILE_COUNTERS; ++i)
+        {
+            file << (i ? ", " : "") << "\"" << PROFILE_COUNTER_NAMES[i] << "\": " << counts[i];
+        }
+        file << "}}\n";
+        return bool(file);
+    }
+
+private:
+
+    struct Timing
+    {
+        uint64_t calls = 0;
+        double total = 0.0;
+        double longest = 0.0;
+
+        void add(double duration)
+        {
+            ++calls;
+            total += duration;
+            longest = std::max(longest, duration);
+        }
+    };
+
+    std::mutex lock;
+    std::vector<std::unique_ptr<ThreadProfile>> threads;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    Profiler() { }
+};
+
+// Times the scope it lives in, with an optional index such as a tile's
+class ScopedTimer
+{ public:
+
+    ScopedTimer(const char* name, int64_t arg = -1)
+        : name(name), arg(arg), start(Profiler::instance().now()) { }
+
+    ~ScopedTimer()
+    {
+        Profiler& profiler = Profiler::instance();
+        profiler.local().event(name, start, profiler.now() - start, arg);
+    }
+
+private:
+
+    const char* name;
+    int64_t arg;
+    double start;
+};
+
+#define PROFILE_JOIN_(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN_(a, b)
+
+#if INSTRUMENT
+#define PROFILE_COUNT(counter) (++Profiler::instance().local().counts[counter])
+#define PROFILE_ADD(counter, n) (Profiler::instance().local().counts[counter] += (n))
+#define PROFILE_PATH(length) Profiler::instance().local().path(length)
+#define PROFILE_SCOPE(...) ScopedTimer PROFILE_JOIN(profileScope, __LINE__)(__VA_ARGS__)
+#else
+#define PROFILE_COUNT(counter) ((void)0)
+#define PROFILE_ADD(counter, n) ((void)0)
+#define PROFILE_PATH(length) ((void)(length))
+#define PROFILE_SCOPE(...) ((void)0)
+#endif
+
+#endif
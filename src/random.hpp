@@ -0,0 +1,166 @@
+#ifndef RANDOM_H_
+#define RANDOM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Scales the top bits of a random integer into [0, 1)
+static const double DOUBLE_UNIT = 1.0 / 9007199254740992.0;
+static const float FLOAT_UNIT = 1.0f / 16777216.0f;
+
+// Generators stepped side by side by a RandomBatch
+static const int RANDOM_LANES = 8;
+
+// Advances a state and returns a well mixed value from it (splitmix64)
+inline uint64_t splitMix(uint64_t& state)
+{
+    uint64_t z = state += 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Mix two values into a well distributed seed
+inline uint32_t hashSeed(uint32_t a, uint32_t b)
+{
+    uint64_t z = uint64_t(a) << 32 | b;
+    return uint32_t(splitMix(z));
+}
+
+inline uint64_t rotl(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+// xoshiro256+ by Blackman and Vigna
+// Small enough to copy around with a path, and its top 53 bits make good doubles
+class Random
+{ public:
+
+    Random(uint64_t seed = 0) { this->seed(seed); }
+
+    void seed(uint64_t seed)
+    {
+        for (int k = 0; k < 4; ++k) s[k] = splitMix(seed);
+    }
+
+    uint64_t next()
+    {
+        const uint64_t result = s[0] + s[3];
+        const uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    // In range 0 <= x < 1
+    double nextDouble() { return (next() >> 11) * DOUBLE_UNIT; }
+    float nextFloat() { return (next() >> 40) * FLOAT_UNIT; }
+
+private:
+
+    uint64_t s[4];
+};
+
+// Independent xoshiro256+ generators stepped together in vector registers
+// Fills whole arrays of uniform values in [0, 1) for loops that want them up front
+class RandomBatch
+{ public:
+
+    RandomBatch(uint64_t seed)
+    {
+        for (int h = 0; h < 2; ++h)
+        {
+            for (int i = 0; i < RANDOM_LANES / 2; ++i)
+            {
+                state[h].s0[i] = splitMix(seed);
+                state[h].s1[i] = splitMix(seed);
+                state[h].s2[i] = splitMix(seed);
+                state[h].s3[i] = splitMix(seed);
+            }
+        }
+    }
+
+    // Mantissa bits under an exponent of one give [1, 2), avoiding integer
+    // conversions that have no vector form before AVX-512
+    void fill(double* out, size_t n)
+    {
+        State a = state[0], b = state[1];
+        for (size_t i = 0; i < n; i += RANDOM_LANES)
+        {
+            Lanes r[2];
+            a.step(r[0]);
+            b.step(r[1]);
+            for (int h = 0; h < 2; ++h)
+            {
+                const Doubles values = (Doubles)(r[h] >> 12 | 0x3FF0000000000000ull) - 1.0;
+                store(out, i + h * RANDOM_LANES / 2, n, values);
+            }
+        }
+        state[0] = a;
+        state[1] = b;
+    }
+
+    void fill(float* out, size_t n)
+    {
+        State a = state[0], b = state[1];
+        for (size_t i = 0; i < n; i += RANDOM_LANES)
+        {
+            Lanes r[2];
+            a.step(r[0]);
+            b.step(r[1]);
+            for (int h = 0; h < 2; ++h)
+            {
+                const Floats values = (Floats)__builtin_convertvector(r[h] >> 41 | 0x3F800000u, Words) - 1.0f;
+                store(out, i + h * RANDOM_LANES / 2, n, values);
+            }
+        }
+        state[0] = a;
+        state[1] = b;
+    }
+
+private:
+
+    // GCC vector extensions, lowered to whatever the target has
+    // Each half is one AVX2 register, as wider vectors split badly on AVX2
+    typedef uint64_t Lanes __attribute__((vector_size(RANDOM_LANES * 4)));
+    typedef uint32_t Words __attribute__((vector_size(RANDOM_LANES * 2)));
+    typedef double Doubles __attribute__((vector_size(RANDOM_LANES * 4)));
+    typedef float Floats __attribute__((vector_size(RANDOM_LANES * 2)));
+
+    struct State
+    {
+        Lanes s0, s1, s2, s3;
+
+        // Results come back by reference, as vectors passed by value have a target dependent ABI
+        void step(Lanes& result)
+        {
+            result = s0 + s3;
+            const Lanes t = s1 << 17;
+            s2 ^= s0;
+            s3 ^= s1;
+            s1 ^= s2;
+            s0 ^= s3;
+            s2 ^= t;
+            s3 = (s3 << 45) | (s3 >> 19);
+        }
+    };
+
+    // Copied into locals while filling, so the state stays in registers
+    State state[2];
+
+    // A partial block at the end keeps what fits
+    template <typename T, typename Vector>
+    static void store(T* out, size_t i, size_t n, const Vector& values)
+    {
+        if (i + RANDOM_LANES / 2 <= n) std::memcpy(out + i, &values, sizeof(values));
+        else if (i < n) std::memcpy(out + i, &values, (n - i) * sizeof(T));
+    }
+};
+
+#endif
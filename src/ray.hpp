@@ -2,19 +2,31 @@
 #define RAY_H_
 
 #include <glm/glm.hpp>
+#include "real.hpp"
 
 class Ray
 { public:
 
-    glm::dvec3 org;
-    glm::dvec3 dir;
+    Vec3 org;
+    Vec3 dir;
 
-    Ray(const glm::dvec3& org, const glm::dvec3& dir) : org(org), dir(dir) { }
+    Ray(const Vec3& org, const Vec3& dir) : org(org), dir(dir) { }
 
-    glm::dvec3 at(double t) const
+    Vec3 at(Real t) const
     {
         return org + t * dir;
     }
 };
 
+// Moves the origin of a ray leaving a surface to the side it leaves by, just past the
+// error bound of the hit point, so it cannot hit that surface again by rounding
+// Replaces a fixed minimum t, which is too small far from the origin in float and
+// needlessly large in double
+inline Vec3 offsetOrigin(const Vec3& point, const Vec3& norm, Real error, const Vec3& dir)
+{
+    Vec3 offset = norm * error;
+    if (glm::dot(dir, norm) < 0) offset = -offset;
+    return point + offset;
+}
+
 #endif
@@ -0,0 +1,23 @@
+#ifndef REAL_H_
+#define REAL_H_
+
+#include <limits>
+#include <glm/glm.hpp>
+#include "config.hpp"
+
+// The scalar the tracer works in, chosen at build time by FLOAT_PRECISION
+// Accumulated images and statistics stay in double either way
+#if FLOAT_PRECISION
+typedef float Real;
+#else
+typedef double Real;
+#endif
+
+typedef glm::tvec3<Real> Vec3;
+
+const Real INF = std::numeric_limits<Real>::infinity();
+
+// Relative rounding error of one operation
+const Real EPSILON = std::numeric_limits<Real>::epsilon();
+
+#endif
@@ -0,0 +1,652 @@
+#ifndef RENDERER_H_
+#define RENDERER_H_
+
+#include <cmath>
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+#include "camera.hpp"
+#include "config.hpp"
+#include "denoise.hpp"
+#include "integrator.hpp"
+#include "options.hpp"
+#include "packet.hpp"
+#include "pool.hpp"
+#include "profile.hpp"
+#include "sampler.hpp"
+#include "scene.hpp"
+#include "utility.hpp"
+
+// Distance between first hits, relative to their depth, past which history shows another surface
+static const double REPROJECT_DISTANCE = 0.02;
+
+// Least cosine between first hit normals for history to be kept
+static const double REPROJECT_NORMAL = 0.9;
+
+// Standard deviations about the fresh samples around a pixel that its history is clipped to
+static const double REPROJECT_CLIP = 1.5;
+
+// Most samples history counts as, so that what it got wrong fades under fresh ones,
+// and fewer where it was taken from a neighbouring pixel
+static const uint32_t REPROJECT_HISTORY = 64;
+static const uint32_t REPROJECT_NEIGHBOUR = 2;
+
+// Accumulates passes of samples into a converging image
+class Renderer
+{ public:
+
+    // Pixel bounds of a tile, with exclusive ends
+    struct Tile
+    {
+        size_t x0, y0, x1, y1;
+    };
+
+    // Called from the worker that finished a tile, once its pixels are final for the pass
+    typedef std::function<void(const Tile&)> TileDone;
+
+    // A share of one tile's samples, which another process may render
+    struct Job
+    {
+        uint32_t tile;
+        uint32_t first;
+        uint32_t count;
+    };
+
+    // What a job adds to each pixel of its tile, in rows
+    struct JobResult
+    {
+        Job job;
+        PathStats stats;
+        std::vector<double> colour;
+        std::vector<float> features;
+    };
+
+    // Values summed per pixel for its features: albedo, normal, position and depth
+    static const size_t FEATURE_SUMS = 10;
+
+    Renderer(int width, int height)
+        : width(width), height(height), sum(width * height * 3), mean(width * height * 3), error(width * height), done(width * height),
+          featureSum(width * height * FEATURE_SUMS), features(width * height) { }
+
+    // Throws away everything accumulated so far
+    void reset()
+    {
+        std::fill(sum.begin(), sum.end(), 0.0);
+        std::fill(featureSum.begin(), featureSum.end(), 0.0f);
+        std::fill(error.begin(), error.end(), Welford());
+        std::fill(done.begin(), done.end(), 0);
+        std::fill(stats.begin(), stats.end(), PathStats());
+        passes = 0;
+        hasCamera = false;
+    }
+
+    // Adds a pass of samples to every pixel still above the noise threshold,
+    // restarting if the camera has moved, from what it saw before if reprojecting
+    // Reprojected passes report the whole image once, when it has been merged with history
+    void render(Pool& pool, const Camera& cam, const Scene& scene, const Options& opts,
+                const TileDone& tileDone = nullptr)
+    {
+        const bool moved = hasCamera && !(cam == lastCam);
+        if (moved && opts.reproject) keepHistory();
+        if (moved) reset();
+        lastCam = cam;
+        hasCamera = true;
+        prepare(pool, opts);
+
+        PROFILE_SCOPE("pass");
+        pool.run(tileCount(), [&](size_t tile, size_t worker)
+        {
+            PROFILE_SCOPE("tile", tile);
+            const Tile t = tileAt(tile);
+
+            // Quiet tiles, and those whose pixels have had all they may take, are skipped entirely
+            bool wanted = false;
+            for (size_t row = t.y0; row < t.y1 && !wanted; ++row)
+            {
+                for (size_t column = t.x0; column < t.x1 && !wanted; ++column)
+                {
+                    wanted = samplesFor(row * width + column, opts) > 0;
+                }
+            }
+            if (!wanted) return;
+
+            if (opts.wavefront) renderWavefront(t, cam, scene, opts, waves[worker], stats[worker]);
+            else renderPaths(t, cam, scene, opts, stats[worker]);
+
+            for (size_t row = t.y0; row < t.y1; ++row)
+            {
+                for (size_t column = t.x0; column < t.x1; ++column)
+                {
+                    resolve(row * width + column);
+                }
+            }
+            if (tileDone && !(moved && opts.reproject)) tileDone(t);
+        });
+
+        if (moved && opts.reproject)
+        {
+            reproject(pool, cam);
+            if (tileDone) tileDone(Tile{ 0, 0, width, height });
+        }
+
+        ++passes;
+        markConverged(opts);
+    }
+
+    size_t tileCount() const
+    {
+        return ((width + TILE_SIZE - 1) / TILE_SIZE) * ((height + TILE_SIZE - 1) / TILE_SIZE);
+    }
+
+    Tile tileAt(size_t index) const
+    {
+        const size_t tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+        Tile t;
+        t.x0 = index % tilesX * TILE_SIZE;
+        t.y0 = index / tilesX * TILE_SIZE;
+        t.x1 = glm::min(t.x0 + TILE_SIZE, width);
+        t.y1 = glm::min(t.y0 + TILE_SIZE, height);
+        return t;
+    }
+
+    // Renders each job's samples afresh, one tile per task, for another renderer to merge
+    // Samples are numbered as in render, so a job gives the same sums wherever it runs
+    // Jobs must name different tiles, which they overwrite
+    void renderJobs(Pool& pool, const Camera& cam, const Scene& scene, const Options& opts,
+                    const std::vector<Job>& jobs, std::vector<JobResult>& results)
+    {
+        prepare(pool, opts);
+        results.resize(jobs.size());
+        pool.run(jobs.size(), [&](size_t i, size_t worker)
+        {
+            PROFILE_SCOPE("job", jobs[i].tile);
+            const Tile t = tileAt(jobs[i].tile);
+            for (size_t row = t.y0; row < t.y1; ++row)
+            {
+                for (size_t column = t.x0; column < t.x1; ++column)
+                {
+                    const size_t p = row * width + column;
+                    std::fill(&sum[p * 3], &sum[p * 3] + 3, 0.0);
+                    std::fill(&featureSum[p * FEATURE_SUMS], &featureSum[p * FEATURE_SUMS] + FEATURE_SUMS, 0.0f);
+                    error[p] = Welford();
+                    error[p].n = jobs[i].first;
+                    done[p] = 0;
+                }
+            }
+
+            Options share = opts;
+            share.samples = jobs[i].count;
+            share.threshold = 0.0;
+            JobResult& result = results[i];
+            result.job = jobs[i];
+            result.stats = PathStats();
+            if (opts.wavefront) renderWavefront(t, cam, scene, share, waves[worker], result.stats);
+            else renderPaths(t, cam, scene, share, result.stats);
+
+            result.colour.clear();
+            result.features.clear();
+            for (size_t row = t.y0; row < t.y1; ++row)
+            {
+                const size_t p = row * width + t.x0, n = t.x1 - t.x0;
+                result.colour.insert(result.colour.end(), &sum[p * 3], &sum[(p + n) * 3]);
+                result.features.insert(result.features.end(), &featureSum[p * FEATURE_SUMS], &featureSum[(p + n) * FEATURE_SUMS]);
+            }
+        });
+    }
+
+    // Adds the samples of a job rendered elsewhere
+    void addJob(const JobResult& result)
+    {
+        const Tile t = tileAt(result.job.tile);
+        size_t i = 0;
+        for (size_t row = t.y0; row < t.y1; ++row)
+        {
+            for (size_t column = t.x0; column < t.x1; ++column, ++i)
+            {
+                const size_t p = row * width + column;
+                Vec3 colour;
+                for (size_t k = 0; k < 3; ++k)
+                {
+                    sum[p * 3 + k] += result.colour[i * 3 + k];
+                    colour[k] = result.colour[i * 3 + k] / result.job.count;
+                }
+                for (size_t k = 0; k < FEATURE_SUMS; ++k) featureSum[p * FEATURE_SUMS + k] += result.features[i * FEATURE_SUMS + k];
+
+                // Only the mean of the job is known, not its spread
+                Welford share;
+                share.n = result.job.count;
+                share.mean = luminance(colour);
+                error[p].add(share);
+                resolve(p);
+            }
+        }
+        stats.resize(glm::max(stats.size(), size_t(1)));
+        stats[0].add(result.stats);
+    }
+
+    // The running mean in linear colour, bottom row first
+    const std::vector<float>& image() const { return mean; }
+
+    // Mean first hit features, updated with the image
+    const FeatureBuffers& featureBuffers() const { return features; }
+
+    // Filters the image with the given number of denoiser passes, for denoised() to return
+    void denoise(Pool& pool, int passes)
+    {
+        denoiser.run(pool, width, height, mean, features, passes, filtered);
+    }
+
+    // The image as last denoised, in linear colour
+    const std::vector<float>& denoised() const { return filtered; }
+
+    // Mean samples per pixel accumulated since the last reset
+    double sampleCount() const
+    {
+        double total = 0.0;
+        for (const Welford& e : error) total += e.n;
+        return total / error.size();
+    }
+
+    // Pixels that the next pass would sample
+    size_t activePixels() const
+    {
+        size_t active = 0;
+        for (size_t p = 0; p < done.size(); ++p) active += !converged(p);
+        return active;
+    }
+
+    // Path statistics gathered since the last reset
+    PathStats pathStats() const
+    {
+        PathStats total;
+        for (const PathStats& s : stats) total.add(s);
+        return total;
+    }
+
+private:
+
+    // Sizes the scratch space for the pool and picks the sampler
+    void prepare(Pool& pool, const Options& opts)
+    {
+        waves.resize(pool.size());
+        stats.resize(pool.size());
+        if (!sampler || samplerName != opts.sampler || samplerSeed != opts.seed)
+        {
+            sampler = makeSampler(opts.sampler, opts.seed);
+            samplerName = opts.sampler;
+            samplerSeed = opts.seed;
+        }
+    }
+
+    // Updates a pixel's means from its sums
+    void resolve(size_t p)
+    {
+        if (!error[p].n) return;
+        for (size_t k = 0; k < 3; ++k) mean[p * 3 + k] = sum[p * 3 + k] / error[p].n;
+
+        const float* f = &featureSum[p * FEATURE_SUMS];
+        for (size_t k = 0; k < 3; ++k)
+        {
+            features.albedo[p * 3 + k] = f[k] / error[p].n;
+            features.normal[p * 3 + k] = f[3 + k] / error[p].n;
+            features.position[p * 3 + k] = f[6 + k] / error[p].n;
+        }
+        features.depth[p] = f[9] / error[p].n;
+    }
+
+    // Keeps what the camera saw so far, for reproject to draw on once it has moved
+    void keepHistory()
+    {
+        historyMean = mean;
+        historyError = error;
+        history = features;
+        historyCam = lastCam;
+    }
+
+    // Merges each pixel's fresh samples with the history its first hit was seen in
+    // History is dropped where the surface differs, as where something came out from behind
+    // another, and clipped to the spread of fresh samples nearby so it cannot ghost
+    void reproject(Pool& pool, const Camera& cam)
+    {
+        fresh = mean;
+        pool.run(height, [&](size_t row, size_t)
+        {
+            for (size_t column = 0; column < width; ++column)
+            {
+                const size_t p = row * width + column;
+                const uint32_t n = error[p].n;
+                bool exact;
+                const int q = historyPixel(p, cam, column, row, exact);
+                if (q < 0 || !n) continue;
+
+                // Mean and spread of the fresh samples around the pixel
+                Vec3 mu(0), square(0);
+                int count = 0;
+                for (size_t y = row ? row - 1 : 0; y <= glm::min(row + 1, height - 1); ++y)
+                {
+                    for (size_t x = column ? column - 1 : 0; x <= glm::min(column + 1, width - 1); ++x)
+                    {
+                        const Vec3 c(fresh[(y * width + x) * 3], fresh[(y * width + x) * 3 + 1], fresh[(y * width + x) * 3 + 2]);
+                        mu += c;
+                        square += c * c;
+                        ++count;
+                    }
+                }
+                mu /= Real(count);
+                const Vec3 spread = Real(REPROJECT_CLIP) * glm::sqrt(glm::max(square / Real(count) - mu * mu, Vec3(0)));
+                const Vec3 old(historyMean[q * 3], historyMean[q * 3 + 1], historyMean[q * 3 + 2]);
+                const Vec3 clipped = glm::clamp(old, mu - spread, mu + spread);
+
+                // History goes in as that many samples of the clipped colour
+                Welford past = historyError[q];
+                const uint32_t m = glm::min(past.n, exact ? REPROJECT_HISTORY : REPROJECT_NEIGHBOUR);
+                past.m2 = past.variance() * (m - 1);
+                past.mean = luminance(clipped);
+                past.n = m;
+                error[p].add(past);
+
+                for (size_t k = 0; k < 3; ++k) sum[p * 3 + k] += clipped[k] * m;
+                float* f = &featureSum[p * FEATURE_SUMS];
+                for (size_t k = 0; k < FEATURE_SUMS; ++k) f[k] *= float(n + m) / n;
+                resolve(p);
+            }
+        });
+    }
+
+    // The pixel of the history that a pixel's first hit was seen in, or -1 if there is none
+    // Fresh samples are few and land anywhere in the pixel, so on an edge the history
+    // pixel found may be on the wrong side, and its neighbours are tried in turn
+    int historyPixel(size_t p, const Camera& cam, size_t column, size_t row, bool& exact) const
+    {
+        // The sky is matched by direction alone, being infinitely far away
+        const bool sky = features.depth[p] <= 0;
+        const Vec3 at(features.position[p * 3], features.position[p * 3 + 1], features.position[p * 3 + 2]);
+        const Vec3 dir = sky ? cameraRay(cam, column, row, 0.5, 0.5).dir : at - historyCam.origin();
+
+        Real u, v;
+        if (!historyCam.project(dir, u, v) || !(u >= 0 && u < 1 && v >= 0 && v < 1)) return -1;
+        const int x = glm::min(int(u * width), int(width) - 1), y = glm::min(int(v * height), int(height) - 1);
+
+        static const int order[9][2] = { {0, 0}, {-1, 0}, {1, 0}, {0, -1}, {0, 1}, {-1, -1}, {1, -1}, {-1, 1}, {1, 1} };
+        for (const auto& step : order)
+        {
+            const int qx = x + step[0], qy = y + step[1];
+            if (qx < 0 || qy < 0 || qx >= int(width) || qy >= int(height)) continue;
+            const size_t q = qy * width + qx;
+            exact = !step[0] && !step[1];
+            if (sameSurface(p, q, sky, at)) return q;
+        }
+        return -1;
+    }
+
+    // Whether a history pixel saw what a pixel's fresh samples did
+    bool sameSurface(size_t p, size_t q, bool sky, const Vec3& at) const
+    {
+        if (!historyError[q].n || (history.depth[q] <= 0) != sky) return false;
+        if (sky) return true;
+
+        const Vec3 seen(history.position[q * 3], history.position[q * 3 + 1], history.position[q * 3 + 2]);
+        if (glm::length(seen - at) > REPROJECT_DISTANCE * features.depth[p]) return false;
+
+        const Vec3 a(features.normal[p * 3], features.normal[p * 3 + 1], features.normal[p * 3 + 2]);
+        const Vec3 b(history.normal[q * 3], history.normal[q * 3 + 1], history.normal[q * 3 + 2]);
+        return glm::dot(a, b) >= REPROJECT_NORMAL * glm::length(a) * glm::length(b);
+    }
+
+    // Whether a pixel's own estimate is good enough, or it has had all it may take
+    // Noise is the standard error of the mean luminance, carried through the
+    // square root gamma so that it matches what is seen on screen
+    bool quiet(size_t p, const Options& opts) const
+    {
+        const Welford& e = error[p];
+        if (e.n >= uint32_t(opts.maxSamples)) return true;
+        if (e.n < ADAPT_MIN_SPP) return false;
+        const double noise = glm::sqrt(e.variance() / e.n) / (2.0 * glm::sqrt(glm::max(e.mean, ADAPT_DARK)));
+        return noise < opts.threshold;
+    }
+
+    // Finishes pixels whose whole neighbourhood is quiet, never within the first two passes
+    // Small sample counts can look converged by chance, such as a dim pixel yet to see
+    // a bright path, and its neighbours are likely to catch what it missed
+    void markConverged(const Options& opts)
+    {
+        std::fill(done.begin(), done.end(), 0);
+        if (opts.threshold <= 0.0 || passes < 2) return;
+
+        std::vector<uint8_t> calm(error.size());
+        for (size_t p = 0; p < error.size(); ++p) calm[p] = quiet(p, opts);
+
+        for (size_t row = 0; row < height; ++row)
+        {
+            for (size_t column = 0; column < width; ++column)
+            {
+                bool all = true;
+                for (size_t y = row ? row - 1 : 0; y <= glm::min(row + 1, height - 1); ++y)
+                {
+                    for (size_t x = column ? column - 1 : 0; x <= glm::min(column + 1, width - 1); ++x)
+                    {
+                        all = all && calm[y * width + x];
+                    }
+                }
+                const size_t p = row * width + column;
+                done[p] = all || error[p].n >= uint32_t(opts.maxSamples);
+            }
+        }
+    }
+
+    bool converged(size_t p) const { return done[p]; }
+
+    // Samples a pixel takes this pass
+    // Headless adaptive passes double what a pixel has so far, so few passes are needed
+    // A pixel at --max-spp takes none, even in the first passes, before any is marked converged
+    int samplesFor(size_t p, const Options& opts) const
+    {
+        const int spp = glm::max(1, opts.samples);
+        if (converged(p)) return 0;
+        if (opts.threshold <= 0.0 || !opts.headless) return spp;
+        const int n = error[p].n;
+        return glm::max(0, glm::min(glm::max(spp, n), opts.maxSamples - n));
+    }
+
+    // Starts this thread's stream on a sample and returns its camera ray
+    // Samples are numbered through every pass, so low discrepancy sequences carry on where
+    // they left off, and each pixel's numbers are the same whatever the thread count,
+    // tiling, packets or integrator
+    Ray startSample(const Camera& cam, size_t column, size_t row, uint32_t seed, uint32_t index) const
+    {
+        SampleStream& stream = sampleStream();
+        stream.start(sampler.get(), column, row, hashSeed(seed, row * width + column), index);
+        double x = stream.next();
+        double y = stream.next();
+        return cameraRay(cam, column, row, x, y);
+    }
+
+    static PathLimits limits(const Options& opts)
+    {
+        return PathLimits{ opts.depth, opts.rouletteDepth, Real(opts.rouletteFloor) };
+    }
+
+    Ray cameraRay(const Camera& cam, size_t column, size_t row, double x, double y) const
+    {
+        return cam.getRay((column + x) / width, (row + y) / height);
+    }
+
+    // Each pixel belongs to a single tile, so workers never share one
+    void addSample(size_t p, const Vec3& color)
+    {
+        for (size_t k = 0; k < 3; ++k) sum[p * 3 + k] += color[k];
+        error[p].add(luminance(color));
+    }
+
+    void addFeatures(size_t p, const Features& f)
+    {
+        float* to = &featureSum[p * FEATURE_SUMS];
+        for (size_t k = 0; k < 3; ++k)
+        {
+            to[k] += f.albedo[k];
+            to[3 + k] += f.normal[k];
+            to[6 + k] += f.position[k];
+        }
+        to[9] += f.depth;
+    }
+
+    // Traces each path to the end before starting the next
+    void renderPaths(const Tile& t, const Camera& cam, const Scene& scene, const Options& opts, PathStats& stats)
+    {
+        const size_t lanes = opts.packets ? PACKET_SIZE : 1;
+        const PathLimits limit = limits(opts);
+
+        for (size_t row = t.y0; row < t.y1; ++row)
+        {
+            // Runs of neighbouring pixels share each packet
+            for (size_t column = t.x0; column < t.x1; column += lanes)
+            {
+                const int n = glm::min(lanes, t.x1 - column);
+                const size_t first = row * width + column;
+                int take[PACKET_SIZE], most = 0;
+                uint32_t base[PACKET_SIZE];
+
+                for (int i = 0; i < n; ++i)
+                {
+                    base[i] = error[first + i].n;
+                    take[i] = samplesFor(first + i, opts);
+                    most = glm::max(most, take[i]);
+                }
+                if (!most) continue;
+
+                for (int s = 0; s < most; ++s)
+                {
+                    RayPacket packet;
+                    packet.clear(0);
+                    SampleStream streams[PACKET_SIZE];
+
+                    for (int i = 0; i < n; ++i)
+                    {
+                        if (s >= take[i]) continue;
+                        Ray ray = startSample(cam, column + i, row, opts.seed, base[i] + s);
+
+                        if (lanes == 1)
+                        {
+                            Features f;
+                            addSample(first + i, trace(ray, scene, limit, stats, nullptr, &f));
+                            addFeatures(first + i, f);
+                        }
+                        else
+                        {
+                            packet.set(i, ray, INF);
+                            streams[i] = sampleStream();
+                        }
+                    }
+
+                    if (lanes == 1 || !packet.active) continue;
+
+                    // Primary rays are found together, and bounces go alone
+                    RayHit hits[PACKET_SIZE];
+                    uint32_t found = scene.hitPacket(packet, hits);
+                    for (int i = 0; i < n; ++i)
+                    {
+                        if (s >= take[i]) continue;
+                        sampleStream() = streams[i];
+                        Ray ray = packet.ray(i);
+                        if (found >> i & 1)
+                        {
+                            Features f;
+                            addSample(first + i, trace(ray, scene, limit, stats, &hits[i], &f));
+                            addFeatures(first + i, f);
+                        }
+                        else
+                        {
+                            // A miss is a whole path of one ray
+                            addSample(first + i, sky(ray));
+                            addFeatures(first + i, skyFeatures(ray));
+                            ++stats.paths;
+                            ++stats.rays;
+                            PROFILE_COUNT(RAYS_TRACED);
+                            PROFILE_PATH(1);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Generates every sample of a tile, as many as fit, then runs them as a wavefront
+    void renderWavefront(const Tile& t, const Camera& cam, const Scene& scene, const Options& opts,
+                         Wavefront& wave, PathStats& stats)
+    {
+        const size_t w = t.x1 - t.x0;
+        const size_t pixels = w * (t.y1 - t.y0);
+
+        int take[TILE_SIZE * TILE_SIZE], most = 0;
+        uint32_t base[TILE_SIZE * TILE_SIZE];
+        size_t wanted = 0;
+        for (size_t i = 0; i < pixels; ++i)
+        {
+            base[i] = error[(t.y0 + i / w) * width + t.x0 + i % w].n;
+            take[i] = samplesFor((t.y0 + i / w) * width + t.x0 + i % w, opts);
+            most = glm::max(most, take[i]);
+            wanted += take[i] > 0;
+        }
+        if (!wanted) return;
+
+        const int batch = glm::max(size_t(1), WAVE_PATHS / wanted);
+        std::vector<PathState> paths;
+        paths.reserve(wanted * batch);
+
+        for (int s0 = 0; s0 < most; s0 += batch)
+        {
+            for (int s = s0; s < glm::min(most, s0 + batch); ++s)
+            {
+                for (size_t i = 0; i < pixels; ++i)
+                {
+                    if (s >= take[i]) continue;
+                    const size_t column = t.x0 + i % w, row = t.y0 + i / w, p = row * width + column;
+                    Ray ray = startSample(cam, column, row, opts.seed, base[i] + s);
+                    paths.push_back(PathState{ ray, Vec3(1), Vec3(0), uint32_t(p), Vec3(0), 0, sampleStream() });
+                }
+            }
+            wave.run(paths, scene, limits(opts), opts.packets, stats, [&](uint32_t p, const Vec3& color)
+            {
+                addSample(p, color);
+            },
+            [&](uint32_t p, const Features& f)
+            {
+                addFeatures(p, f);
+            });
+        }
+    }
+
+    size_t width, height;
+    std::vector<double> sum;
+    std::vector<float> mean;
+    std::vector<Welford> error;
+    std::vector<uint8_t> done;
+    uint32_t passes = 0;
+
+    // Sums of each pixel's features, and their means
+    std::vector<float> featureSum;
+    FeatureBuffers features;
+
+    // The image and features from before the camera last moved, and fresh colour to clip it by
+    std::vector<float> historyMean;
+    std::vector<Welford> historyError;
+    FeatureBuffers history;
+    Camera historyCam;
+    std::vector<float> fresh;
+
+    Denoiser denoiser;
+    std::vector<float> filtered;
+
+    Camera lastCam;
+    bool hasCamera = false;
+
+    // Scratch space for each worker
+    std::vector<Wavefront> waves;
+    std::vector<PathStats> stats;
+
+    std::unique_ptr<Sampler> sampler;
+    std::string samplerName;
+    uint32_t samplerSeed = 0;
+};
+
+#endif
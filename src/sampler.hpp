@@ -0,0 +1,409 @@
+#ifndef SAMPLER_H_
+#define SAMPLER_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "random.hpp"
+
+// Dimensions taken by the position within the pixel
+static const uint32_t PIXEL_DIMS = 2;
+
+// Dimensions reserved for each bounce, so bounce k always starts at the same one
+static const uint32_t BOUNCE_DIMS = 4;
+
+// Dimensions reserved for the light sampled at each bounce, numbered from far past any bounce's
+// own so that those are the same whether or not a scene has lights
+static const uint32_t LIGHT_DIMS = 4;
+static const uint32_t LIGHT_DIMS_START = 1u << 20;
+
+// Places a dimension in the order a path uses them: the pixel, then at each bounce its own
+// dimensions followed by those of the light sampled there
+// Samplers with few good dimensions, such as Halton's bases, give them out in this order, so
+// no two dimensions share one and shallow light samples are as well spread as bounces
+inline uint32_t dimensionRank(uint32_t dim)
+{
+    if (dim < PIXEL_DIMS) return dim;
+    const uint32_t stride = BOUNCE_DIMS + LIGHT_DIMS;
+    if (dim >= LIGHT_DIMS_START)
+    {
+        const uint32_t light = dim - LIGHT_DIMS_START;
+        return PIXEL_DIMS + light / LIGHT_DIMS * stride + BOUNCE_DIMS + light % LIGHT_DIMS;
+    }
+    const uint32_t bounce = dim - PIXEL_DIMS;
+    return PIXEL_DIMS + bounce / BOUNCE_DIMS * stride + bounce % BOUNCE_DIMS;
+}
+
+// Side of the tiled blue noise mask
+static const int BLUE_NOISE_SIZE = 64;
+
+class Sampler;
+
+// The numbers one path draws, taken dimension by dimension from a Sampler
+// Small enough to travel with a path in a wavefront
+struct SampleStream
+{
+    const Sampler* sampler = nullptr;
+
+    // Which sample of which pixel, and a seed unique to the pixel
+    uint32_t x = 0, y = 0, index = 0, seed = 0;
+    uint32_t dim = 0;
+
+    // Independent numbers, for the random sampler and when no sampler is set
+    Random random;
+
+    // Scratch kept by samplers between dimensions of one sample
+    uint32_t cacheKey = ~0u, cacheValue = 0;
+
+    void start(const Sampler* sampler, uint32_t x, uint32_t y, uint32_t seed, uint32_t index)
+    {
+        this->sampler = sampler;
+        this->x = x;
+        this->y = y;
+        this->seed = seed;
+        this->index = index;
+        dim = 0;
+        cacheKey = ~0u;
+        random.seed(hashSeed(seed, index));
+    }
+
+    // Jumps to the dimensions of a bounce, counted from the first hit
+    void bounce(int depth)
+    {
+        dim = PIXEL_DIMS + depth * BOUNCE_DIMS;
+    }
+
+    // Jumps to the dimensions of the light sampled at a bounce
+    void light(int depth)
+    {
+        dim = LIGHT_DIMS_START + depth * LIGHT_DIMS;
+    }
+
+    inline double next();
+};
+
+// Chooses the numbers paths use, one dimension at a time
+// Implementations hold no per sample state, so one is shared by every thread
+class Sampler
+{ public:
+
+    virtual ~Sampler() { }
+
+    // In range 0 <= x < 1
+    virtual double get(SampleStream& stream, uint32_t dim) const = 0;
+};
+
+double SampleStream::next()
+{
+    if (!sampler) return random.nextDouble();
+    return sampler->get(*this, dim++);
+}
+
+// Each thread owns a stream, started by whoever hands it work
+inline SampleStream& sampleStream()
+{
+    thread_local SampleStream stream;
+    return stream;
+}
+
+// Plain random numbers for work outside of a pixel, such as building a scene
+inline void seedRandom(uint64_t seed)
+{
+    SampleStream& stream = sampleStream();
+    stream.sampler = nullptr;
+    stream.random.seed(seed);
+}
+
+inline uint32_t reverseBits(uint32_t x)
+{
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00FF00FFu) << 8) | ((x & 0xFF00FF00u) >> 8);
+    x = ((x & 0x0F0F0F0Fu) << 4) | ((x & 0xF0F0F0F0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xCCCCCCCCu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xAAAAAAAAu) >> 1);
+    return x;
+}
+
+// Hash based nested uniform scrambling (Laine and Karras, improved by Burley)
+// Each bit is flipped depending only on the bits above it, which keeps stratification
+inline uint32_t owenScramble(uint32_t x, uint32_t seed)
+{
+    x = reverseBits(x);
+    x += seed;
+    x ^= x * 0x6C50B47Cu;
+    x ^= x * 0xB82F1E52u;
+    x ^= x * 0xC7AFE638u;
+    x ^= x * 0x8D22F6E6u;
+    return reverseBits(x);
+}
+
+// The first four Sobol dimensions, as XOR tables for each byte of the index
+class SobolTable
+{ public:
+
+    SobolTable()
+    {
+        // Primitive polynomials and initial direction numbers (Joe and Kuo)
+        static const uint32_t degree[4] = { 0, 1, 2, 3 };
+        static const uint32_t coeffs[4] = { 0, 0, 1, 1 };
+        static const uint32_t initial[4][3] = { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 3, 0 }, { 1, 3, 1 } };
+
+        for (int d = 0; d < 4; ++d)
+        {
+            uint32_t v[32];
+            const uint32_t s = degree[d];
+            for (uint32_t i = 0; i < 32; ++i)
+            {
+                if (d == 0) v[i] = 1u << (31 - i);
+                else if (i < s) v[i] = initial[d][i] << (31 - i);
+                else
+                {
+                    v[i] = v[i - s] ^ (v[i - s] >> s);
+                    for (uint32_t k = 1; k < s; ++k) v[i] ^= ((coeffs[d] >> (s - 1 - k)) & 1) * v[i - k];
+                }
+            }
+
+            for (int b = 0; b < 4; ++b)
+            {
+                for (int value = 0; value < 256; ++value)
+                {
+                    uint32_t x = 0;
+                    for (int bit = 0; bit < 8; ++bit)
+                    {
+                        if (value >> bit & 1) x ^= v[b * 8 + bit];
+                    }
+                    bytes[d][b][value] = x;
+                }
+            }
+        }
+    }
+
+    uint32_t get(uint32_t index, uint32_t dim) const
+    {
+        return bytes[dim][0][index & 0xFF] ^ bytes[dim][1][index >> 8 & 0xFF]
+             ^ bytes[dim][2][index >> 16 & 0xFF] ^ bytes[dim][3][index >> 24];
+    }
+
+private:
+
+    uint32_t bytes[4][4][256];
+};
+
+inline const SobolTable& sobolTable()
+{
+    static const SobolTable table;
+    return table;
+}
+
+// Owen scrambled Sobol points in [0, 1)
+// Dimensions come in sets of four, each with its own shuffle of the index, which pads
+// the sequence out to as many dimensions as a path needs (Burley 2020)
+inline double sobolOwen(SampleStream& stream, uint32_t dim, uint32_t seed)
+{
+    const uint32_t set = dim / 4;
+    if (stream.cacheKey != set)
+    {
+        stream.cacheKey = set;
+        stream.cacheValue = owenScramble(stream.index, hashSeed(seed, set));
+    }
+    uint32_t x = sobolTable().get(stream.cacheValue, dim % 4);
+    x = owenScramble(x, hashSeed(seed ^ 0x5A17ED5Eu, dim));
+    return x * (1.0 / 4294967296.0);
+}
+
+// Independent uniform numbers, with no structure between samples
+class RandomSampler: public Sampler
+{ public:
+
+    double get(SampleStream& stream, uint32_t) const
+    {
+        return stream.random.nextDouble();
+    }
+};
+
+class SobolSampler: public Sampler
+{ public:
+
+    double get(SampleStream& stream, uint32_t dim) const
+    {
+        return sobolOwen(stream, dim, stream.seed);
+    }
+};
+
+// The Halton sequence, each dimension's digits scrambled by its own random affine permutation
+// per pixel (Matousek), which keeps its stratification while breaking up patterns between bases
+// Bases go to dimensions by rank, and those ranked past the last prime take hashed random
+// numbers, as reusing a base would repeat an earlier dimension exactly
+class HaltonSampler: public Sampler
+{ public:
+
+    double get(SampleStream& stream, uint32_t dim) const
+    {
+        static const uint32_t primes[] =
+        {
+            2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+            59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131
+        };
+        const uint32_t rank = dimensionRank(dim);
+        if (rank >= sizeof(primes) / sizeof(primes[0]))
+        {
+            uint64_t state = uint64_t(hashSeed(stream.seed, stream.index)) << 32 | dim;
+            return (splitMix(state) >> 11) * DOUBLE_UNIT;
+        }
+        const uint32_t base = primes[rank];
+
+        // Radical inverse of the scrambled digits
+        const uint32_t key = hashSeed(stream.seed, dim);
+        const double inv = 1.0 / base;
+        double scale = inv, value = 0.0;
+        uint32_t digit = 0;
+        for (uint32_t i = stream.index; i; i /= base, ++digit)
+        {
+            const uint32_t h = hashSeed(key, digit);
+            const uint32_t multiplier = 1 + h % (base - 1);
+            const uint32_t offset = (h >> 16) % base;
+            value += (uint64_t(i % base) * multiplier + offset) % base * scale;
+            scale *= inv;
+        }
+
+        // Zeros past the index's own digits scramble to independent uniform digits, which
+        // together are one uniform number below the last
+        uint64_t state = uint64_t(key) << 32 | digit;
+        value += (splitMix(state) >> 11) * DOUBLE_UNIT * scale * base;
+        return value < 1.0 ? value : 1.0 - DOUBLE_UNIT;
+    }
+};
+
+// Sobol points shared by every pixel, each shifted by a tiled blue noise mask
+// Neighbouring pixels then err in different directions, so what noise remains is
+// high frequency and far less visible (Georgiev and Fajardo, Heitz and Belcour)
+class BlueNoiseSampler: public Sampler
+{ public:
+
+    BlueNoiseSampler(uint32_t seed) : seed(seed), mask(voidAndCluster(seed)) { }
+
+    double get(SampleStream& stream, uint32_t dim) const
+    {
+        // Each dimension reads the mask from its own offset
+        const uint32_t offset = hashSeed(seed, dim);
+        const uint32_t x = (stream.x + offset) % BLUE_NOISE_SIZE;
+        const uint32_t y = (stream.y + (offset >> 16)) % BLUE_NOISE_SIZE;
+        double value = sobolOwen(stream, dim, seed) + mask[y * BLUE_NOISE_SIZE + x];
+        return value >= 1.0 ? value - 1.0 : value;
+    }
+
+private:
+
+    uint32_t seed;
+    std::vector<float> mask;
+
+    // Ranks every cell of a toroidal grid so that each prefix is evenly spread (Ulichney)
+    static std::vector<float> voidAndCluster(uint32_t seed)
+    {
+        const int size = BLUE_NOISE_SIZE, cells = size * size;
+        const double sigma = 1.5;
+
+        // Gaussian weight of every toroidal offset
+        std::vector<double> kernel(cells);
+        for (int dy = 0; dy < size; ++dy)
+        {
+            for (int dx = 0; dx < size; ++dx)
+            {
+                const int x = std::min(dx, size - dx), y = std::min(dy, size - dy);
+                kernel[dy * size + dx] = std::exp(-(x * x + y * y) / (2.0 * sigma * sigma));
+            }
+        }
+
+        auto update = [&](std::vector<double>& energy, int cell, double sign)
+        {
+            const int cx = cell % size, cy = cell / size;
+            for (int y = 0; y < size; ++y)
+            {
+                const double* row = &kernel[((y - cy + size) % size) * size];
+                for (int x = 0; x < size; ++x) energy[y * size + x] += sign * row[(x - cx + size) % size];
+            }
+        };
+
+        // The most crowded set cell, or the emptiest unset one
+        auto extreme = [&](const std::vector<double>& energy, const std::vector<uint8_t>& set, bool crowded)
+        {
+            int best = -1;
+            for (int i = 0; i < cells; ++i)
+            {
+                if (set[i] != crowded) continue;
+                if (best < 0 || (crowded ? energy[i] > energy[best] : energy[i] < energy[best])) best = i;
+            }
+            return best;
+        };
+
+        // A random tenth of the cells to start from
+        std::vector<double> noise(cells);
+        RandomBatch(seed).fill(noise.data(), cells);
+        std::vector<uint8_t> set(cells);
+        std::vector<double> energy(cells, 0.0);
+        int ones = 0;
+        for (int i = 0; i < cells; ++i)
+        {
+            if (noise[i] >= 0.1) continue;
+            set[i] = 1;
+            update(energy, i, 1.0);
+            ++ones;
+        }
+
+        // Moves points from clusters into voids until the pattern settles, which it
+        // normally does long before every cell has had a turn
+        for (int swaps = 0; ones && swaps < cells; ++swaps)
+        {
+            const int cluster = extreme(energy, set, true);
+            set[cluster] = 0;
+            update(energy, cluster, -1.0);
+            const int hole = extreme(energy, set, false);
+            set[hole] = 1;
+            update(energy, hole, 1.0);
+            if (hole == cluster) break;
+        }
+
+        std::vector<int> rank(cells);
+
+        // Ranks the initial points by removing the most crowded first
+        {
+            std::vector<uint8_t> left = set;
+            std::vector<double> leftEnergy = energy;
+            for (int r = ones - 1; r >= 0; --r)
+            {
+                const int cluster = extreme(leftEnergy, left, true);
+                left[cluster] = 0;
+                update(leftEnergy, cluster, -1.0);
+                rank[cluster] = r;
+            }
+        }
+
+        // Then the rest, each filling the biggest remaining void
+        for (int r = ones; r < cells; ++r)
+        {
+            const int hole = extreme(energy, set, false);
+            set[hole] = 1;
+            update(energy, hole, 1.0);
+            rank[hole] = r;
+        }
+
+        std::vector<float> mask(cells);
+        for (int i = 0; i < cells; ++i) mask[i] = (rank[i] + 0.5f) / cells;
+        return mask;
+    }
+};
+
+// Returns nullptr for an unknown name
+inline std::unique_ptr<Sampler> makeSampler(const std::string& name, uint32_t seed)
+{
+    if (name == "random") return std::unique_ptr<Sampler>(new RandomSampler());
+    if (name == "sobol") return std::unique_ptr<Sampler>(new SobolSampler());
+    if (name == "halton") return std::unique_ptr<Sampler>(new HaltonSampler());
+    if (name == "bluenoise") return std::unique_ptr<Sampler>(new BlueNoiseSampler(seed));
+    return nullptr;
+}
+
+#endif
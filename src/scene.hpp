@@ -0,0 +1,90 @@
+#ifndef SCENE_H_
+#define SCENE_H_
+
+#include <cstdint>
+#include <memory>
+#include "bvh.hpp"
+#include "config.hpp"
+#include "geometry.hpp"
+#include "light.hpp"
+#include "material.hpp"
+#include "spheres.hpp"
+
+// Where the camera starts, which scene files may set
+struct View
+{
+    Vec3 from = Vec3(13, 2, 3);
+    Vec3 at = Vec3(0);
+    Real vfov = VFOV;
+};
+
+// A scene compiled for tracing, with spheres packed under one BVH and materials in a flat table
+// Hits name their material by index, so tracing touches no reference counts
+class Scene
+{ public:
+
+    MaterialTable materials;
+    View view;
+
+    // Every sphere of the scene, if it has any
+    std::shared_ptr<SphereSet> spheres;
+
+    // The emissive spheres among them, which diffuse hits sample directly
+    LightList lights;
+
+    BVH world;
+
+    Scene(const Geometry& builder, const View& view = View())
+        : view(view), world(packSpheres(builder, materials))
+    {
+        findSpheres();
+    }
+
+    // Takes surfaces already built, such as those of a loaded scene
+    Scene(MaterialTable&& materials, const Geometry& objects, const View& view)
+        : materials(std::move(materials)), view(view), world(objects)
+    {
+        findSpheres();
+    }
+
+    bool hit(const Ray& ray, Real tMin, Real tMax, RayHit& hit) const
+    {
+        return world.hit(ray, tMin, tMax, hit);
+    }
+
+    bool occluded(const Ray& ray, Real tMin, Real tMax) const
+    {
+        return world.occluded(ray, tMin, tMax);
+    }
+
+    uint32_t hitPacket(RayPacket& packet, RayHit* hits) const
+    {
+        return world.hitPacket(packet, hits);
+    }
+
+    bool scatter(const Ray& in, const RayHit& hit, Vec3& atten, Ray& scattered) const
+    {
+        return materials.scatter(in, hit, atten, scattered);
+    }
+
+private:
+
+    void findSpheres()
+    {
+        for (const auto& object : world.objects)
+        {
+            if (!spheres) spheres = std::dynamic_pointer_cast<SphereSet>(object);
+        }
+        if (!spheres) return;
+
+        const SphereArrays<Real>& s = spheres->data();
+        const uint32_t* mats = spheres->materials();
+        for (size_t i = 0; i < spheres->size(); ++i)
+        {
+            const MaterialData& m = materials[mats[i]];
+            if (m.type == EMISSIVE) lights.add(Vec3(s.x[i], s.y[i], s.z[i]), s.rad[i], mats[i], m.albedo);
+        }
+    }
+};
+
+#endif
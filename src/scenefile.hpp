@@ -0,0 +1,440 @@
+#ifndef SCENEFILE_H_
+#define SCENEFILE_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "instance.hpp"
+#include "lines.hpp"
+#include "mapping.hpp"
+#include "obj.hpp"
+#include "scene.hpp"
+
+// Scene files are text, one item per line, and anything after # is ignored
+//   camera FROMX FROMY FROMZ ATX ATY ATZ [VFOV]
+//   material NAME diffuse R G B
+//   material NAME metal R G B FUZZ
+//   material NAME dielectric INDEX
+//   material NAME emissive R G B
+//   sphere X Y Z RADIUS MATERIAL
+//   mesh FILE.obj MATERIAL
+//   instance FILE.obj MATERIAL X Y Z SCALE YAW
+// Materials must be named before they are used
+// Each mesh is read once for all the lines placing it, and an instance turns it by YAW degrees about y
+// Emissive spheres are sampled as lights, while emissive meshes are only found by bounces
+
+// Bumped whenever the cache layout changes
+static const uint32_t SCENE_CACHE_VERSION = 2;
+
+// Sections of the cache start on cache lines, so mapped arrays are as aligned as built ones
+static const uint64_t SCENE_CACHE_ALIGN = 64;
+
+// Reads a scene file a block at a time, adding spheres straight into their packed arrays
+// Mesh paths are relative to the scene file, and instances sit under the scene's top level BVH
+inline std::unique_ptr<Scene> loadSceneText(const std::string& path)
+{
+    MaterialTable materials;
+    std::unordered_map<std::string, uint32_t> names;
+    auto spheres = std::make_shared<SphereSet>();
+    Geometry objects;
+    View view;
+
+    const size_t slash = path.find_last_of("/\\");
+    const std::string folder = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    std::string word;
+
+    // Meshes by file and material, shared by every line naming them
+    std::unordered_map<std::string, std::shared_ptr<TriangleMesh>> meshes;
+    auto meshFor = [&](std::string file, uint32_t mat)
+    {
+        if (file[0] != '/' && file.find(':') == std::string::npos) file = folder + file;
+        std::shared_ptr<TriangleMesh>& mesh = meshes[file + "\n" + std::to_string(mat)];
+        if (!mesh) mesh = loadOBJ(file, mat);
+        return mesh;
+    };
+
+    const bool read = readLines(path, [&](TextLine& line, std::string& problem)
+    {
+        auto fail = [&](const std::string& why)
+        {
+            problem = why;
+            return false;
+        };
+
+        if (!line.word(word)) return true;
+
+        if (word == "camera")
+        {
+            Real v[6];
+            for (Real& x : v) if (!line.number(x)) return fail("Bad camera");
+            view.from = Vec3(v[0], v[1], v[2]);
+            view.at = Vec3(v[3], v[4], v[5]);
+            if (!line.finished() && !line.number(view.vfov)) return fail("Bad field of view");
+        }
+        else if (word == "material")
+        {
+            std::string name, type;
+            if (!line.word(name) || !line.word(type)) return fail("Bad material");
+
+            MaterialData data = { DIFFUSE, Vec3(1), 0, 1 };
+            bool read = true;
+            if (type == "diffuse" || type == "metal" || type == "emissive")
+            {
+                data.type = type == "diffuse" ? DIFFUSE : type == "metal" ? METAL : EMISSIVE;
+                read = line.number(data.albedo.x) && line.number(data.albedo.y) && line.number(data.albedo.z);
+                if (data.type == METAL) read = read && line.number(data.fuzz);
+            }
+            else if (type == "dielectric")
+            {
+                data.type = DIELECTRIC;
+                read = line.number(data.index);
+            }
+            else return fail("Unknown material type " + type);
+
+            if (!read) return fail("Bad " + type + " material");
+            if (names.count(name)) return fail("Material " + name + " named twice");
+            names[name] = materials.add(data);
+        }
+        else if (word == "sphere")
+        {
+            Real x, y, z, rad;
+            std::string name;
+            if (!line.number(x) || !line.number(y) || !line.number(z) || !line.number(rad) || !line.word(name))
+            {
+                return fail("Bad sphere");
+            }
+            auto found = names.find(name);
+            if (found == names.end()) return fail("Unknown material " + name);
+            spheres->add(Vec3(x, y, z), rad, found->second);
+        }
+        else if (word == "mesh" || word == "instance")
+        {
+            std::string file, name;
+            if (!line.word(file) || !line.word(name)) return fail("Bad " + word);
+            auto found = names.find(name);
+            if (found == names.end()) return fail("Unknown material " + name);
+
+            Real v[5];
+            if (word == "instance")
+            {
+                for (Real& x : v) if (!line.number(x)) return fail("Bad instance");
+                if (v[3] == 0) return fail("Instance scaled to nothing");
+            }
+
+            auto mesh = meshFor(file, found->second);
+            if (!mesh) return fail("Cannot load mesh " + file);
+            if (word == "mesh") objects.add(mesh);
+            else objects.add(std::make_shared<Instance>(mesh, Transform::placement(Vec3(v[0], v[1], v[2]), v[3], v[4])));
+        }
+        else return fail("Unknown item " + word);
+
+        if (!line.finished()) return fail("Extra values after " + word);
+        return true;
+    });
+    if (!read) return nullptr;
+
+    spheres->build();
+    if (spheres->size()) objects.add(spheres);
+    return std::unique_ptr<Scene>(new Scene(std::move(materials), objects, view));
+}
+
+// Writes a scene back out as text, with materials numbered in table order
+// Only spheres are written, as meshes and instances keep no record of the files they came from
+inline bool saveSceneText(const std::string& path, const Scene& scene)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        std::cerr << "ERROR: Cannot open " << path << std::endl;
+        return false;
+    }
+    file.precision(std::numeric_limits<Real>::max_digits10);
+
+    const View& v = scene.view;
+    file << "camera " << v.from.x << " " << v.from.y << " " << v.from.z << " "
+         << v.at.x << " " << v.at.y << " " << v.at.z << " " << v.vfov << "\n";
+
+    for (size_t i = 0; i < scene.materials.size(); ++i)
+    {
+        const MaterialData& m = scene.materials[i];
+        file << "material m" << i;
+        if (m.type == DIELECTRIC) file << " dielectric " << m.index << "\n";
+        else
+        {
+            file << (m.type == METAL ? " metal " : m.type == EMISSIVE ? " emissive " : " diffuse ") << m.albedo.x << " " << m.albedo.y << " " << m.albedo.z;
+            if (m.type == METAL) file << " " << m.fuzz;
+            file << "\n";
+        }
+    }
+
+    if (scene.spheres)
+    {
+        const SphereArrays<Real>& s = scene.spheres->data();
+        const uint32_t* mats = scene.spheres->materials();
+        for (size_t i = 0; i < scene.spheres->size(); ++i)
+        {
+            file << "sphere " << s.x[i] << " " << s.y[i] << " " << s.z[i] << " " << s.rad[i] << " m" << mats[i] << "\n";
+        }
+    }
+
+    return bool(file.flush());
+}
+
+// Start of the binary cache, which holds a compiled scene exactly as it is traced
+struct SceneCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+
+    // Layouts the arrays were written with
+    uint32_t realSize;
+    uint32_t materialSize;
+    uint32_t nodeSize;
+    uint32_t padding;
+
+    // The scene file the cache was made from
+    FileStamp source;
+
+    uint64_t materials;
+    uint64_t spheres;
+    uint64_t nodes;
+    double view[7];
+};
+
+// Where each array of a cache starts, following from the counts in its header
+struct SceneCacheLayout
+{
+    uint64_t materials, x, y, z, rad, mats, nodes, end;
+
+    // Bytes in each padded coordinate array
+    uint64_t reals;
+
+    SceneCacheLayout(const SceneCacheHeader& h)
+    {
+        reals = h.spheres ? (h.spheres + SPHERE_PADDING) * sizeof(Real) : 0;
+        materials = align(sizeof(SceneCacheHeader));
+        x = align(materials + h.materials * sizeof(MaterialData));
+        y = align(x + reals);
+        z = align(y + reals);
+        rad = align(z + reals);
+        mats = align(rad + reals);
+        nodes = align(mats + h.spheres * sizeof(uint32_t));
+        end = nodes + h.nodes * sizeof(BVHNode);
+    }
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + SCENE_CACHE_ALIGN - 1) / SCENE_CACHE_ALIGN * SCENE_CACHE_ALIGN;
+    }
+};
+
+inline SceneCacheHeader sceneCacheHeader()
+{
+    SceneCacheHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, "RTIOWSC", 8);
+    h.version = SCENE_CACHE_VERSION;
+    h.byteOrder = 0x01020304;
+    h.realSize = sizeof(Real);
+    h.materialSize = sizeof(MaterialData);
+    h.nodeSize = sizeof(BVHNode);
+    h.padding = SPHERE_PADDING;
+    return h;
+}
+
+// Writes the compiled scene, stamped with the scene file it came from
+inline bool saveSceneCache(const std::string& path, const Scene& scene, const FileStamp& source)
+{
+    static const SphereSet empty;
+    const SphereSet& spheres = scene.spheres ? *scene.spheres : empty;
+
+    SceneCacheHeader h = sceneCacheHeader();
+    h.source = source;
+    h.materials = scene.materials.size();
+    h.spheres = spheres.size();
+    h.nodes = spheres.hierarchy().size();
+    const View& v = scene.view;
+    const double view[7] = { v.from.x, v.from.y, v.from.z, v.at.x, v.at.y, v.at.z, v.vfov };
+    std::memcpy(h.view, view, sizeof(view));
+    const SceneCacheLayout layout(h);
+
+    // Written beside the cache and then moved over it, as other processes may have the old one mapped,
+    // and truncating a file under a mapping faults its readers
+    const std::string temporary = path + ".tmp." + std::to_string(processId());
+    std::ofstream file(temporary, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "ERROR: Cannot open " << temporary << std::endl;
+        return false;
+    }
+
+    // Each array is written at its offset, zero filling the gaps
+    auto put = [&](uint64_t offset, const void* data, uint64_t bytes)
+    {
+        static const char zeros[SCENE_CACHE_ALIGN] = { };
+        file.write(zeros, offset - uint64_t(file.tellp()));
+        file.write(static_cast<const char*>(data), bytes);
+    };
+
+    const uint64_t reals = layout.reals;
+    const SphereArrays<Real>& s = spheres.data();
+    file.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    put(layout.materials, scene.materials.data(), h.materials * sizeof(MaterialData));
+    if (h.spheres)
+    {
+        put(layout.x, s.x, reals);
+        put(layout.y, s.y, reals);
+        put(layout.z, s.z, reals);
+        put(layout.rad, s.rad, reals);
+        put(layout.mats, spheres.materials(), h.spheres * sizeof(uint32_t));
+        put(layout.nodes, spheres.hierarchy().data(), h.nodes * sizeof(BVHNode));
+    }
+
+    file.close();
+    if (!file)
+    {
+        std::cerr << "ERROR: Cannot write " << temporary << std::endl;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    if (!replaceFile(temporary, path))
+    {
+        std::cerr << "ERROR: Cannot replace " << path << std::endl;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Whether the arrays of a cache hold only what tracing can follow, so a damaged one is rebuilt
+// rather than read out of bounds
+// Counts must fit in the file, leaves and materials must lie within their arrays, and every
+// child must follow its parent, within the depth traversal has room for
+inline bool validSceneCache(const SceneCacheHeader& h, const uint8_t* base, size_t size)
+{
+    if (h.materials > size / sizeof(MaterialData) || h.spheres > size / sizeof(Real)
+        || h.spheres > std::numeric_limits<uint32_t>::max() || h.nodes > size / sizeof(BVHNode)
+        || !h.spheres != !h.nodes)
+    {
+        return false;
+    }
+    const SceneCacheLayout layout(h);
+    if (size < layout.end) return false;
+
+    for (uint64_t i = 0; i < h.materials; ++i)
+    {
+        MaterialData data;
+        std::memcpy(&data, base + layout.materials + i * sizeof(MaterialData), sizeof(data));
+        if (data.type > EMISSIVE) return false;
+    }
+
+    const uint32_t* mats = reinterpret_cast<const uint32_t*>(base + layout.mats);
+    for (uint64_t i = 0; i < h.spheres; ++i)
+    {
+        if (mats[i] >= h.materials) return false;
+    }
+
+    const BVHNode* nodes = reinterpret_cast<const BVHNode*>(base + layout.nodes);
+    std::vector<int> depth(h.nodes, -1);
+    if (h.nodes) depth[0] = 0;
+    for (uint64_t i = 0; i < h.nodes; ++i)
+    {
+        const BVHNode& node = nodes[i];
+        if (depth[i] < 0) continue;
+        if (node.count)
+        {
+            if (uint64_t(node.start) + node.count > h.spheres) return false;
+            continue;
+        }
+        if (node.start <= i + 1 || node.start >= h.nodes || depth[i] + 2 >= BVH_STACK) return false;
+        depth[i + 1] = std::max(depth[i + 1], depth[i] + 1);
+        depth[node.start] = std::max(depth[node.start], depth[i] + 1);
+    }
+    return true;
+}
+
+// Maps a cache and traces straight from it, with nothing parsed or rebuilt
+// Returns null, quietly, if the cache is missing, stale, damaged or from another build
+inline std::unique_ptr<Scene> loadSceneCache(const std::string& path, const FileStamp& source)
+{
+    auto mapped = std::make_shared<MappedFile>();
+    if (!mapped->open(path) || mapped->size() < sizeof(SceneCacheHeader)) return nullptr;
+
+    SceneCacheHeader h;
+    std::memcpy(&h, mapped->data(), sizeof(h));
+    SceneCacheHeader expected = sceneCacheHeader();
+    if (std::memcmp(h.magic, expected.magic, 8) || h.version != expected.version
+        || h.byteOrder != expected.byteOrder || h.realSize != expected.realSize
+        || h.materialSize != expected.materialSize || h.nodeSize != expected.nodeSize
+        || h.padding != expected.padding || !(h.source == source)
+        || !validSceneCache(h, mapped->data(), mapped->size()))
+    {
+        return nullptr;
+    }
+    const SceneCacheLayout layout(h);
+    const uint8_t* base = mapped->data();
+
+    // Materials are few, so they are copied into their table
+    MaterialTable materials;
+    for (uint64_t i = 0; i < h.materials; ++i)
+    {
+        MaterialData data;
+        std::memcpy(&data, base + layout.materials + i * sizeof(MaterialData), sizeof(data));
+        materials.add(data);
+    }
+
+    auto spheres = std::make_shared<SphereSet>();
+    if (h.spheres)
+    {
+        const SphereArrays<Real> arrays = {
+            reinterpret_cast<const Real*>(base + layout.x), reinterpret_cast<const Real*>(base + layout.y),
+            reinterpret_cast<const Real*>(base + layout.z), reinterpret_cast<const Real*>(base + layout.rad) };
+        spheres->adopt(arrays, reinterpret_cast<const uint32_t*>(base + layout.mats), h.spheres,
+                       reinterpret_cast<const BVHNode*>(base + layout.nodes), h.nodes, mapped);
+    }
+
+    View view;
+    view.from = Vec3(h.view[0], h.view[1], h.view[2]);
+    view.at = Vec3(h.view[3], h.view[4], h.view[5]);
+    view.vfov = h.view[6];
+    Geometry objects;
+    if (h.spheres) objects.add(spheres);
+    return std::unique_ptr<Scene>(new Scene(std::move(materials), objects, view));
+}
+
+// Loads a scene file through its cache beside it, parsing and caching it afresh if the cache is stale
+inline std::unique_ptr<Scene> loadScene(const std::string& path, bool& cached)
+{
+    FileStamp stamp;
+    if (!stamp.read(path))
+    {
+        std::cerr << "ERROR: Cannot open " << path << std::endl;
+        return nullptr;
+    }
+
+    const std::string cachePath = path + ".cache";
+    std::unique_ptr<Scene> scene = loadSceneCache(cachePath, stamp);
+    cached = bool(scene);
+    if (scene) return scene;
+
+    scene = loadSceneText(path);
+    if (!scene) return nullptr;
+
+    // Only spheres are cached, so scenes with meshes are read afresh each time
+    bool spheresOnly = true;
+    for (const auto& object : scene->world.objects) spheresOnly = spheresOnly && object == scene->spheres;
+    if (spheresOnly) saveSceneCache(cachePath, *scene, stamp);
+    return scene;
+}
+
+#endif
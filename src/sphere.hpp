@@ -1,45 +1,87 @@
 #ifndef SPHERE_H_
 #define SPHERE_H_
 
+#include <memory>
+#include "material.hpp"
+#include "profile.hpp"
 #include "surface.hpp"
 
+// Rounding steps a sphere's hit point may stray, in units of its largest coordinate
+static const Real SPHERE_ERROR_ULPS = 16;
+
+// Finds where a ray meets a sphere, as t values either side of the closest approach
+// b * b - a * c cancels badly for small or distant spheres, which doubles can afford but
+// float cannot, so float finds the distance of the closest approach from the centre first
+// Returns false if the ray misses
+inline bool sphereRoots(const Vec3& org, const Vec3& dir, const Vec3& mid, Real rad, Real& t0, Real& t1)
+{
+    const Vec3 f = org - mid;
+    const Real invA = 1 / glm::dot(dir, dir);
+    const Real k = glm::dot(f, dir) * invA;
+    Real h;
+    if (FLOAT_PRECISION)
+    {
+        const Vec3 l = f - k * dir;
+        h = rad * rad - glm::dot(l, l);
+    }
+    else h = k * glm::dot(f, dir) - (glm::dot(f, f) - rad * rad);
+    if (h <= 0) return false;
+
+    const Real root = glm::sqrt(h * invA);
+    t0 = -k - root;
+    t1 = -k + root;
+    return true;
+}
+
+// Fills in a hit, moving the point onto the sphere so its error depends on the sphere alone
+inline void sphereHit(const Ray& ray, Real t, const Vec3& mid, Real rad, RayHit& hit)
+{
+    const Vec3 offset = ray.at(t) - mid;
+    const Real scale = 1 / glm::sqrt(glm::dot(offset, offset));
+    const Vec3 outwardNorm = offset * (rad < 0 ? -scale : scale);
+    hit.t = t;
+    hit.point = mid + offset * (glm::abs(rad) * scale);
+    hit.error = SPHERE_ERROR_ULPS * EPSILON
+              * (glm::max(glm::abs(mid.x), glm::max(glm::abs(mid.y), glm::abs(mid.z))) + glm::abs(rad));
+    hit.setNorm(ray, outwardNorm);
+}
+
 class Sphere: public Surface
 { public:
 
-    glm::dvec3 mid;
-    double rad;
+    Vec3 mid;
+    Real rad;
     std::shared_ptr<Material> mat;
 
+    // Where mat sits in a MaterialTable, for spheres traced without being packed
+    uint32_t matIndex = 0;
+
     Sphere() { }
-    Sphere(glm::dvec3 mid, double rad, std::shared_ptr<Material> mat) : mid(mid), rad(rad), mat(mat) { }
+    Sphere(Vec3 mid, Real rad, std::shared_ptr<Material> mat) : mid(mid), rad(rad), mat(mat) { }
 
-    bool hit(const Ray& ray, double tMin, double tMax, RayHit& hit) const
+    bool hit(const Ray& ray, Real tMin, Real tMax, RayHit& hit) const
     {
-        glm::dvec3 org = ray.org - mid;
-        double a = glm::length2(ray.dir);
-        double b = dot(org, ray.dir);
-        double c = glm::length2(org) - rad * rad;
-        double discriminant = b * b - a * c;
+        Real t0, t1;
+        PROFILE_COUNT(SPHERE_TESTS);
+        if (!sphereRoots(ray.org, ray.dir, mid, rad, t0, t1)) return false;
 
-        if (discriminant > 0)
+        for (Real t : { t0, t1 })
         {
-            double root = sqrt(discriminant);
-            for (const int& i : {1, -1})
+            if (t < tMax && t > tMin)
             {
-                double temp = (b + root * i) / -a;
-                if (temp < tMax && temp > tMin)
-                {
-                    hit.t = temp;
-                    hit.point = ray.at(hit.t);
-                    glm::dvec3 outwardNorm = (hit.point - mid) / rad;
-                    hit.setNorm(ray, outwardNorm);
-                    hit.mat = mat;
-                    return true;
-                }
+                sphereHit(ray, t, mid, rad, hit);
+                hit.mat = matIndex;
+                return true;
             }
         }
         return false;
     }
+
+    bool bounds(AABB& box) const
+    {
+        box = AABB(mid - Vec3(glm::abs(rad)), mid + Vec3(glm::abs(rad)));
+        return true;
+    }
 };
 
 #endif
@@ -0,0 +1,235 @@
+#ifndef SPHERES_H_
+#define SPHERES_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "bvh.hpp"
+#include "geometry.hpp"
+#include "kernels.hpp"
+#include "sphere.hpp"
+
+// Leaves hold up to this many kernel widths of spheres
+static const uint32_t SPHERE_LEAF_BATCHES = 2;
+
+// Padding past the last sphere, so the widest kernel can overrun it
+static const uint32_t SPHERE_PADDING = 16;
+
+// Packed spheres in structure-of-arrays form, with their own BVH
+class SphereSet: public Surface
+{ public:
+
+    SphereSet() { }
+
+    // The arrays are referenced by raw pointer once built
+    SphereSet(const SphereSet&) = delete;
+    SphereSet& operator=(const SphereSet&) = delete;
+
+    // Materials are given as indices into the scene's MaterialTable
+    void add(const Vec3& mid, Real rad, uint32_t mat)
+    {
+        midX.push_back(mid.x);
+        midY.push_back(mid.y);
+        midZ.push_back(mid.z);
+        radii.push_back(rad);
+        matIndex.push_back(mat);
+        ++sphereCount;
+    }
+
+    // Sorts the spheres into leaf order, after which none may be added
+    void build()
+    {
+        const size_t n = matIndex.size();
+        std::vector<AABB> boxes(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            Vec3 mid(midX[i], midY[i], midZ[i]), r(glm::abs(radii[i]));
+            boxes[i] = AABB(mid - r, mid + r);
+        }
+        unsigned width;
+        sphereKernel<Real>(nullptr, &width);
+        tree.build(boxes, glm::max(4u, width * SPHERE_LEAF_BATCHES), width);
+
+        // Leaves then cover contiguous runs of every array
+        permute(midX);
+        permute(midY);
+        permute(midZ);
+        permute(radii);
+        permute(matIndex);
+
+        // Padding lets vector loads run past the final sphere
+        for (size_t i = 0; i < SPHERE_PADDING; ++i)
+        {
+            midX.push_back(0);
+            midY.push_back(0);
+            midZ.push_back(0);
+            radii.push_back(0);
+        }
+
+        adopt(SphereArrays<Real>{ midX.data(), midY.data(), midZ.data(), radii.data() },
+              matIndex.data(), matIndex.size(), tree.data(), tree.size(), nullptr);
+    }
+
+    // Traces arrays and nodes stored elsewhere, already in leaf order and padded
+    // The backing object is kept alive for as long as this set is
+    void adopt(const SphereArrays<Real>& spheres, const uint32_t* mats, size_t n,
+               const BVHNode* nodes, size_t nodeCount, std::shared_ptr<const void> backing)
+    {
+        arrays = spheres;
+        matArray = mats;
+        sphereCount = n;
+        tree.adopt(nodes, nodeCount);
+        kernel = sphereKernel<Real>(nullptr);
+        this->backing = backing;
+    }
+
+    size_t size() const { return sphereCount; }
+
+    // Arrays in leaf order, padded, for writing out
+    const SphereArrays<Real>& data() const { return arrays; }
+    const uint32_t* materials() const { return matArray; }
+    const BVHTree& hierarchy() const { return tree; }
+
+    bool hit(const Ray& ray, Real tMin, Real tMax, RayHit& hit) const
+    {
+        const Real a = glm::length2(ray.dir);
+        const KernelRay<Real> r = { ray.org.x, ray.org.y, ray.org.z, ray.dir.x, ray.dir.y, ray.dir.z, a, 1 / a };
+
+        long best = -1;
+        Real t = tMax;
+        tree.traverse(ray, tMin, tMax, [&](uint32_t start, uint32_t count, Real& closest)
+        {
+            PROFILE_ADD(SPHERE_TESTS, count);
+            long i = kernel(arrays, start, count, r, tMin, closest);
+            if (i < 0) return false;
+            best = i;
+            t = closest;
+            return true;
+        });
+        if (best < 0) return false;
+
+        // Only the closest sphere gets a full hit record
+        sphereHit(ray, t, Vec3(arrays.x[best], arrays.y[best], arrays.z[best]), arrays.rad[best], hit);
+        hit.mat = matArray[best];
+        return true;
+    }
+
+    bool occluded(const Ray& ray, Real tMin, Real tMax) const
+    {
+        const Real a = glm::length2(ray.dir);
+        const KernelRay<Real> r = { ray.org.x, ray.org.y, ray.org.z, ray.dir.x, ray.dir.y, ray.dir.z, a, 1 / a };
+        return tree.any(ray, tMin, tMax, [&](uint32_t start, uint32_t count)
+        {
+            PROFILE_ADD(SPHERE_TESTS, count);
+            Real closest = tMax;
+            return kernel(arrays, start, count, r, tMin, closest) >= 0;
+        });
+    }
+
+    // Tests each leaf sphere against every lane of the packet at once
+    uint32_t hitPacket(RayPacket& packet, RayHit* hits) const
+    {
+        long best[PACKET_SIZE];
+        for (int i = 0; i < PACKET_SIZE; ++i) best[i] = -1;
+
+        alignas(64) Real invA[PACKET_SIZE];
+        for (int i = 0; i < PACKET_SIZE; ++i)
+        {
+            invA[i] = 1 / (packet.dx[i] * packet.dx[i] + packet.dy[i] * packet.dy[i] + packet.dz[i] * packet.dz[i]);
+        }
+
+        tree.traverse(packet, [&](uint32_t start, uint32_t count, uint32_t mask)
+        {
+            // Every lane is tested, active or not
+            PROFILE_ADD(SPHERE_TESTS, count * PACKET_SIZE);
+            for (uint32_t s = start; s < start + count; ++s)
+            {
+                const Real cx = arrays.x[s], cy = arrays.y[s], cz = arrays.z[s], r2 = arrays.rad[s] * arrays.rad[s];
+                for (int i = 0; i < PACKET_SIZE; ++i)
+                {
+                    Real fx = packet.ox[i] - cx, fy = packet.oy[i] - cy, fz = packet.oz[i] - cz;
+                    Real b = fx * packet.dx[i] + fy * packet.dy[i] + fz * packet.dz[i];
+                    Real k = b * invA[i];
+                    Real h;
+                    if (FLOAT_PRECISION)
+                    {
+                        Real lx = fx - k * packet.dx[i], ly = fy - k * packet.dy[i], lz = fz - k * packet.dz[i];
+                        h = r2 - (lx * lx + ly * ly + lz * lz);
+                    }
+                    else h = k * b - (fx * fx + fy * fy + fz * fz - r2);
+                    Real root = glm::sqrt(glm::max(h, Real(0)) * invA[i]);
+                    Real t0 = -k - root;
+                    Real t1 = -k + root;
+                    bool in0 = t0 > packet.tMin && t0 < packet.tMax[i];
+                    bool in1 = t1 > packet.tMin && t1 < packet.tMax[i];
+                    bool take = (mask >> i & 1) && h > 0 && (in0 || in1);
+                    packet.tMax[i] = take ? (in0 ? t0 : t1) : packet.tMax[i];
+                    best[i] = take ? long(s) : best[i];
+                }
+            }
+        });
+
+        uint32_t found = 0;
+        for (int i = 0; i < PACKET_SIZE; ++i)
+        {
+            if (best[i] < 0) continue;
+            const Vec3 mid(arrays.x[best[i]], arrays.y[best[i]], arrays.z[best[i]]);
+            sphereHit(packet.ray(i), packet.tMax[i], mid, arrays.rad[best[i]], hits[i]);
+            hits[i].mat = matArray[best[i]];
+            found |= 1u << i;
+        }
+        return found;
+    }
+
+    bool bounds(AABB& box) const
+    {
+        box = tree.bounds();
+        return size() > 0;
+    }
+
+private:
+
+    // Storage while building, which the arrays below point into
+    AlignedVector<Real> midX, midY, midZ, radii;
+    std::vector<uint32_t> matIndex;
+
+    BVHTree tree;
+    SphereArrays<Real> arrays = { };
+    const uint32_t* matArray = nullptr;
+    size_t sphereCount = 0;
+    std::shared_ptr<const void> backing;
+
+    SphereKernel<Real> kernel = &hitSpheresScalar<Real>;
+
+    template <typename Vector>
+    void permute(Vector& values) const
+    {
+        Vector sorted(values.size());
+        for (size_t i = 0; i < values.size(); ++i) sorted[i] = values[tree.order[i]];
+        values.swap(sorted);
+    }
+};
+
+// Moves every Sphere of a Geometry into one SphereSet, keeping the rest
+// Their materials are added to the table
+inline Geometry packSpheres(const Geometry& world, MaterialTable& materials)
+{
+    Geometry packed;
+    auto spheres = std::make_shared<SphereSet>();
+
+    for (const auto& object : world.objects)
+    {
+        auto sphere = std::dynamic_pointer_cast<Sphere>(object);
+        if (sphere) spheres->add(sphere->mid, sphere->rad, materials.add(sphere->mat));
+        else packed.add(object);
+    }
+
+    if (spheres->size())
+    {
+        spheres->build();
+        packed.add(spheres);
+    }
+    return packed;
+}
+
+#endif
@@ -1,28 +1,67 @@
 #ifndef SURFACE_H_
 #define SURFACE_H_
 
+#include <cstdint>
 #include "ray.hpp"
-class Material;
+#include "aabb.hpp"
+#include "packet.hpp"
 
 struct RayHit
 {
-    glm::dvec3 point;
-    glm::dvec3 norm;
-    std::shared_ptr<Material> mat;
-    double t;
+    Vec3 point;
+    Vec3 norm;
+    uint32_t mat; // Index into the scene's MaterialTable
+    Real t;
     bool front;
 
-    inline void setNorm(const Ray& ray, const glm::dvec3& outwardNorm)
+    // Furthest the point may be from the true surface, through rounding
+    Real error;
+
+    inline void setNorm(const Ray& ray, const Vec3& outwardNorm)
     {
         front = dot(ray.dir, outwardNorm) < 0;
-        norm = outwardNorm * (front ? 1.0 : -1.0);
+        norm = front ? outwardNorm : -outwardNorm;
+    }
+
+    // A ray leaving the hit point, safely clear of the surface
+    Ray spawn(const Vec3& dir) const
+    {
+        return Ray(offsetOrigin(point, norm, error, dir), dir);
     }
 };
 
 class Surface
 { public:
 
-    virtual bool hit(const Ray& ray, double tMin, double tMax, RayHit& hit) const = 0;
+    virtual bool hit(const Ray& ray, Real tMin, Real tMax, RayHit& hit) const = 0;
+
+    // Whether anything lies along the ray within (tMin, tMax), for shadow rays
+    // Any hit will do, so surfaces that can stop at the first should
+    virtual bool occluded(const Ray& ray, Real tMin, Real tMax) const
+    {
+        RayHit hit;
+        return this->hit(ray, tMin, tMax, hit);
+    }
+
+    // Returns false for surfaces without finite bounds
+    virtual bool bounds(AABB& box) const = 0;
+
+    // Finds closer hits for the active rays of a packet, shortening their tMax
+    // Returns the lanes hit here, and by default traces one ray at a time
+    virtual uint32_t hitPacket(RayPacket& packet, RayHit* hits) const
+    {
+        uint32_t mask = 0;
+        for (int i = 0; i < PACKET_SIZE; ++i)
+        {
+            if (!(packet.active >> i & 1)) continue;
+            if (hit(packet.ray(i), packet.tMin, packet.tMax[i], hits[i]))
+            {
+                packet.tMax[i] = hits[i].t;
+                mask |= 1u << i;
+            }
+        }
+        return mask;
+    }
 };
 
 #endif
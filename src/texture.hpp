@@ -3,6 +3,9 @@
 
 #define GLEW_STATIC
 #include <GL/glew.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
 
 static const float vertices[] =
 {
@@ -19,10 +22,21 @@ static const unsigned int indices[] =
     0, 3, 2  // Triangle 2
 };
 
+// Texels to update, from the bottom left
+struct TextureRect
+{
+    GLint x, y;
+    GLsizei width, height;
+};
+
+// Pixel buffers that uploads rotate through, so one is filled while the GPU copies from another
+static const int TEXTURE_BUFFERS = 3;
+
+// A screen filling image, updated in place through pixel buffers
 class Texture
 { public:
 
-    Texture()
+    Texture(GLsizei width, GLsizei height) : width(width), height(height), shownWidth(width)
     {
         glGenVertexArrays(1, &vao);
         glGenBuffers(1, &vbo);
@@ -46,27 +60,107 @@ class Texture
         glBindTexture(GL_TEXTURE_2D, tex);
 
         // Set the texture wrapping parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-        // Set texture filtering parameters
+        // Set texture filtering parameters, without mipmaps as the quad is never minified
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+        // Storage is made once, and immutable where supported, so updates never reallocate it
+        if (GLEW_ARB_texture_storage) glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+        else glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+        glGenBuffers(TEXTURE_BUFFERS, buffers);
+        for (GLuint buffer : buffers)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes(), nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
     }
 
     // Destructor
     ~Texture()
     {
+        for (GLsync fence : fences) if (fence) glDeleteSync(fence);
+        glDeleteBuffers(TEXTURE_BUFFERS, buffers);
+        glDeleteTextures(1, &tex);
         glDeleteVertexArrays(1, &vao);
         glDeleteBuffers(1, &vbo);
         glDeleteBuffers(1, &ebo);
     }
 
-    // Replace pixel values
-    void fill(GLsizei width, GLsizei height, GLubyte* pixels)
+    // Shows only the bottom left width by height texels, stretched over the quad, so a frame
+    // rendered smaller is scaled up by the filtering
+    // Uploads after this are laid out at the new width
+    void crop(GLsizei width, GLsizei height)
     {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        shownWidth = width;
+
+        // Cropped edges stop at the centres of the last texels shown, so none of the stale
+        // texels beyond are blended in
+        const float u = width < this->width ? (width - 0.5f) / this->width : 1.0f;
+        const float v = height < this->height ? (height - 0.5f) / this->height : 1.0f;
+        float cropped[16];
+        std::copy(vertices, vertices + 16, cropped);
+        for (int i = 0; i < 4; ++i)
+        {
+            cropped[i * 4 + 2] *= u;
+            cropped[i * 4 + 3] *= v;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(cropped), cropped);
+    }
+
+    // The next pixel buffer to write into, laid out as the shown image in RGBA bytes,
+    // bottom row first, then handed to upload
+    // Waits only if the GPU has yet to finish copying out of it
+    // Returns null if the buffer cannot be mapped, leaving the ring where it was
+    GLubyte* map()
+    {
+        const int next = (current + 1) % TEXTURE_BUFFERS;
+        if (fences[next])
+        {
+            glClientWaitSync(fences[next], GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+            glDeleteSync(fences[next]);
+            fences[next] = nullptr;
+        }
+
+        // Fenced already, so the driver need not synchronise
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[next]);
+        GLubyte* bytes = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, this->bytes(), GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (!bytes)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return nullptr;
+        }
+        current = next;
+        mapped = true;
+        return bytes;
+    }
+
+    // Copies areas of the mapped buffer into the texture, returning before the copy is done
+    // Does nothing unless map succeeded
+    void upload(const std::vector<TextureRect>& rects)
+    {
+        if (!mapped) return;
+        mapped = false;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[current]);
+        const bool intact = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, shownWidth);
+        for (const TextureRect& r : rects)
+        {
+            // Contents lost while mapped, such as on a display mode change, are not copied
+            if (!intact) break;
+            const size_t offset = (size_t(r.y) * shownWidth + r.x) * 4;
+            glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.width, r.height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)offset);
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
     }
 
     // Prepare for use
@@ -85,7 +179,15 @@ class Texture
 
 private:
 
+    GLsizei width, height;
+    GLsizei shownWidth;
     unsigned int tex, vbo, vao, ebo;
+    GLuint buffers[TEXTURE_BUFFERS];
+    GLsync fences[TEXTURE_BUFFERS] = { };
+    int current = 0;
+    bool mapped = false;
+
+    GLsizeiptr bytes() const { return GLsizeiptr(width) * height * 4; }
 };
 
 #endif
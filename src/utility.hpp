@@ -1,69 +1,93 @@
 #ifndef UTILITY_H_
 #define UTILITY_H_
 
-#include <limits>
-#include <cstdlib>
-#include <random>
+#include <cstdint>
 #include <glm/glm.hpp>
+#include "real.hpp"
+#include "sampler.hpp"
 
-const double INF = std::numeric_limits<double>::infinity();
-
-// Return a double in range 0 <= x < 1
-inline double random()
+// Return a double in range 0 <= x < 1, from the next dimension of this thread's sample
+inline double randomDouble()
 {
-    return rand() / (RAND_MAX + 1.0);
+    return sampleStream().next();
 }
 
 // Return a double in range min <= x < max
-inline double random(double min, double max)
+inline double randomDouble(double min, double max)
 {
-    return min + (max - min) * random();
+    return min + (max - min) * randomDouble();
 }
 
-// Return a double in range 0 <= x < 1
-inline double randomDouble()
+// Running mean and variance, updated one value at a time (Welford)
+struct Welford
+{
+    uint32_t n = 0;
+    double mean = 0.0;
+    double m2 = 0.0;
+
+    void add(double x)
+    {
+        double delta = x - mean;
+        mean += delta / ++n;
+        m2 += delta * (x - mean);
+    }
+
+    // Takes in another set of values as if added one by one (Chan et al.)
+    void add(const Welford& other)
+    {
+        if (!other.n) return;
+        const double delta = other.mean - mean;
+        const uint32_t total = n + other.n;
+        m2 += other.m2 + delta * delta * n * other.n / total;
+        mean += delta * other.n / total;
+        n = total;
+    }
+
+    double variance() const { return n > 1 ? m2 / (n - 1) : 0.0; }
+};
+
+// Perceived brightness of a linear colour
+inline double luminance(const Vec3& c)
 {
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    static std::mt19937 generator;
-    return distribution(generator);
+    return 0.2126 * c.r + 0.7152 * c.g + 0.0722 * c.b;
 }
 
 // Returns a random unit vector
-glm::dvec3 randomUnit()
+Vec3 randomUnit()
 {
-    double a = random(0.0, 2.0 * glm::pi<double>());
-    double z = random(-1.0, 1.0);
-    double r = glm::sqrt(1.0 - z * z);
-    return glm::dvec3(r * glm::cos(a), r * glm::sin(a), z);
+    Real a = randomDouble(0.0, 2.0 * glm::pi<double>());
+    Real z = randomDouble(-1.0, 1.0);
+    Real r = glm::sqrt(1 - z * z);
+    return Vec3(r * glm::cos(a), r * glm::sin(a), z);
 }
 
 // Returns a random unit vector in a hemisphere
-glm::dvec3 randomHemi(const glm::dvec3& norm)
+Vec3 randomHemi(const Vec3& norm)
 {
-    glm::dvec3 unit = randomUnit();
-    if (glm::dot(unit, norm) < 0.0) unit *= -1.0;
+    Vec3 unit = randomUnit();
+    if (glm::dot(unit, norm) < 0) unit = -unit;
     return unit;
 }
 
 // GLM provides this
-glm::dvec3 refract(const glm::dvec3& i, const glm::dvec3& n, double eta)
+Vec3 refract(const Vec3& i, const Vec3& n, Real eta)
 {
-    double cosTheta = -glm::dot(i, n);
-    glm::dvec3 para = eta * (i + cosTheta * n);
-    return para - sqrt(1.0 - glm::length2(para)) * n;
+    Real cosTheta = -glm::dot(i, n);
+    Vec3 para = eta * (i + cosTheta * n);
+    return para - glm::sqrt(1 - glm::length2(para)) * n;
 }
 
 // Christophe Schlick's polynomial approximation for dielectric reflectivity
-double schlick(double cosine, double index)
+Real schlick(Real cosine, Real index)
 {
-    double r0 = (1 - index) / (1 + index);
+    Real r0 = (1 - index) / (1 + index);
     r0 = r0 * r0;
-    return r0 + (1 - r0) * pow((1 - cosine), 5);
+    return r0 + (1 - r0) * glm::pow(1 - cosine, Real(5));
 }
 
-glm::dvec3 randomColor()
+Vec3 randomColor()
 {
-    return glm::dvec3(random(), random(), random());
+    return Vec3(randomDouble(), randomDouble(), randomDouble());
 }
 
 #endif